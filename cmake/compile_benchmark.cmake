@@ -0,0 +1,86 @@
+# Generates a project of many test files and times their compilation with
+# each way of including litetest: litetest.h, the default, core.h, and every
+# feature header along with litetest.h, so that changes to the headers can
+# be checked for their effect on build times. Run through the
+# compile_benchmark target, or directly:
+#
+#   cmake -DCXX=g++ -DINCLUDE_DIR=litetest -DWORK_DIR=/tmp/bench -P cmake/compile_benchmark.cmake
+#
+# Files are compiled one after the other, with GCC/Clang style options.
+
+cmake_minimum_required(VERSION 3.23)
+
+foreach(var CXX INCLUDE_DIR WORK_DIR)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "${var} must be defined.")
+    endif()
+endforeach()
+if(NOT DEFINED N_FILES)
+    set(N_FILES 50)
+endif()
+if(NOT DEFINED N_CASES)
+    set(N_CASES 20)
+endif()
+if(NOT DEFINED CXX_FLAGS)
+    set(CXX_FLAGS -std=c++17 -O0)
+endif()
+
+# Microseconds since the epoch.
+function(now out)
+    string(TIMESTAMP time "%s%f" UTC)
+    set(${out} ${time} PARENT_SCOPE)
+endfunction()
+
+# Headers included by each variant, named after the first. async.h is left
+# out, as coroutines need C++20.
+set(variant_litetest litetest.h)
+set(variant_core core.h)
+set(variant_features litetest.h params.h property.h bulk.h perf.h benchmark.h)
+
+foreach(name litetest core features)
+    set(includes)
+    foreach(header ${variant_${name}})
+        string(APPEND includes "#include \"${header}\"\n")
+    endforeach()
+    set(dir ${WORK_DIR}/${name})
+    file(REMOVE_RECURSE ${dir})
+    file(MAKE_DIRECTORY ${dir})
+
+    # Typical test files: a suite with cases testing common types.
+    set(sources)
+    math(EXPR last_file "${N_FILES} - 1")
+    math(EXPR last_case "${N_CASES} - 1")
+    foreach(i RANGE ${last_file})
+        set(code "${includes}\nTEST_SUITE(suite_${i});\n")
+        foreach(j RANGE ${last_case})
+            string(APPEND code "
+TEST_CASE(case_${j}) {
+    int n = ${j};
+    std::string str = \"value ${j}\";
+    EXPECT(n + 1).to_be(${j} + 1);
+    EXPECT(n * 0.5).to_be_less_than(${j} + 1.0);
+    EXPECT(str.size() > 0).to_be(true);
+    EXPECT(str).to_not_be(\"other\");
+}
+")
+        endforeach()
+        file(WRITE ${dir}/test_${i}.cpp "${code}")
+        list(APPEND sources ${dir}/test_${i}.cpp)
+    endforeach()
+
+    now(start)
+    foreach(source ${sources})
+        execute_process(
+            COMMAND ${CXX} ${CXX_FLAGS} -I ${INCLUDE_DIR} -c ${source} -o ${source}.o
+            RESULT_VARIABLE result)
+        if(NOT result EQUAL 0)
+            message(FATAL_ERROR "Compiling ${source} failed.")
+        endif()
+    endforeach()
+    now(end)
+
+    math(EXPR total_ms "(${end} - ${start}) / 1000")
+    math(EXPR per_file_ms "${total_ms} / ${N_FILES}")
+    string(REPLACE ";" ", " headers "${variant_${name}}")
+    message(STATUS "${headers}: ${N_FILES} files in ${total_ms} ms, ${per_file_ms} ms per file")
+endforeach()
@@ -0,0 +1,5 @@
+#include <litetest.h>
+
+int main(int argc, char* argv[]) {
+    return litetest::litetest_main(argc, argv);
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#include <litetest.h>
+#include <async.h>
+
+#include <chrono>
+#include <unistd.h>
+
+TEST_SUITE(SuiteAsync);
+
+TEST_CASE_ASYNC(CaseSleep) {
+    co_await litetest::sleep_for(std::chrono::milliseconds(10));
+    EXPECT(1 + 1).to_be(2); // Success expected
+}
+
+TEST_CASE_ASYNC(CasePipe) {
+    int fds[2];
+    EXPECT(pipe(fds)).to_be(0);
+    EXPECT(write(fds[1], "x", 1)).to_be(1);
+    co_await litetest::readable(fds[0]);
+    char c = 0;
+    EXPECT(read(fds[0], &c, 1)).to_be(1);
+    close(fds[0]);
+    close(fds[1]);
+    EXPECT(c).to_be('x'); // Success expected
+}
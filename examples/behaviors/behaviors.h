@@ -0,0 +1,18 @@
+#ifndef BEHAVIORS_H
+#define BEHAVIORS_H
+
+#include <atomic>
+
+// Switches the driver flips between runs, and counts it reads after them.
+
+/** Makes HistoryFlaky pass. */
+extern std::atomic<bool> g_fix_flaky;
+
+/** Threads that arrived in StressBarrier's iterations so far. */
+extern std::atomic<int> g_stress_arrivals;
+
+/** Instances of FixtureSuite's fixture built and destroyed. */
+extern std::atomic<int> g_fixtures_built;
+extern std::atomic<int> g_fixtures_destroyed;
+
+#endif // BEHAVIORS_H
@@ -0,0 +1,263 @@
+#include <litetest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "behaviors.h"
+
+// Runs the suites of this example through run_tests() and checks what the
+// runs did, rather than only that they finished: each check prints "ok" or
+// "FAILED", and the program fails if any did. Cases of these suites fail,
+// crash and hang on purpose, so their own reports are expected to.
+
+namespace {
+
+int s_n_failed_checks = 0;
+
+void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok - " : "FAILED - ") << what << std::endl;
+    if (!ok) {
+        s_n_failed_checks++;
+    }
+}
+
+litetest::RunTestsArgs args_for(std::vector<std::string> suites) {
+    litetest::RunTestsArgs args;
+    args.suites = std::move(suites);
+    return args;
+}
+
+/** Names of the cases a run executed, in the order they finished. */
+std::vector<std::string> case_names(const litetest::RunTestsResults& results) {
+    std::vector<std::string> names;
+    for (const litetest::CaseReport& report: results.cases) {
+        names.push_back(report.name);
+    }
+    return names;
+}
+
+const litetest::CaseReport* find_case(const litetest::RunTestsResults& results, const std::string& name) {
+    for (const litetest::CaseReport& report: results.cases) {
+        if (report.name == name) {
+            return &report;
+        }
+    }
+    return nullptr;
+}
+
+bool has_status(const litetest::RunTestsResults& results, const std::string& name, litetest::CaseStatus status) {
+    const litetest::CaseReport* report = find_case(results, name);
+    return report && report->status == status;
+}
+
+bool contains(const std::string& text, const std::string& part) {
+    return text.find(part) != std::string::npos;
+}
+
+/** A path in the temporary directory, with no file there yet. */
+std::string temp_file(const std::string& name) {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / ("litetest-behaviors-" + name);
+    std::filesystem::remove(path);
+    return path.string();
+}
+
+void check_sharding() {
+    const std::vector<std::string> suites { "ShardA", "ShardB", "ShardC", "ShardD", "ShardE", "ShardF" };
+    const std::map<std::string, double> seconds {
+        { "ShardA", 6 }, { "ShardB", 5 }, { "ShardC", 4 }, { "ShardD", 3 }, { "ShardE", 2 }, { "ShardF", 1 }
+    };
+
+    // Timings are keyed by the location of suites, which a first run reports.
+    std::string timings_file = temp_file("timings");
+    litetest::RunTestsResults all = litetest::run_tests(args_for(suites));
+
+    // Longest first to the least loaded shard splits them into 6+1, 5+2 and 4+3.
+    std::multiset<std::string> executed;
+    bool balanced = true;
+    for (int shard = 0; shard < 3; ++shard) {
+        // Every shard starts from the same timings, as if run on its own machine.
+        {
+            std::ofstream file(timings_file);
+            for (const litetest::SuiteReport& suite: all.suites) {
+                file << seconds.at(suite.name) << ' ' << suite.src_file << ':' << suite.line << '\n';
+            }
+        }
+        litetest::RunTestsArgs args = args_for(suites);
+        args.shard_count = 3;
+        args.shard_index = shard;
+        args.timings_file = timings_file;
+        litetest::RunTestsResults results = litetest::run_tests(args);
+        double shard_seconds = 0;
+        for (const litetest::SuiteReport& suite: results.suites) {
+            executed.insert(suite.name);
+            shard_seconds += seconds.at(suite.name);
+        }
+        balanced = balanced && shard_seconds == 7;
+    }
+    check(executed == std::multiset<std::string>(suites.begin(), suites.end()),
+          "shards run every suite exactly once");
+    check(balanced, "shards have the same expected duration");
+    std::filesystem::remove(timings_file);
+}
+
+void check_history() {
+    litetest::RunTestsArgs args = args_for({ "History" });
+    args.state_file = temp_file("state");
+
+    g_fix_flaky = false;
+    litetest::RunTestsResults results = litetest::run_tests(args);
+    check(has_status(results, "HistoryFlaky", litetest::CaseStatus::FAILED), "the flaky case fails at first");
+
+    args.failed_first = true;
+    results = litetest::run_tests(args);
+    check(case_names(results) == std::vector<std::string> { "HistoryFlaky", "HistoryFirst", "HistoryLast" },
+          "failed-first runs the failed case first");
+
+    args.failed_first = false;
+    args.rerun_failed = true;
+    results = litetest::run_tests(args);
+    check(case_names(results) == std::vector<std::string> { "HistoryFlaky" },
+          "rerun-failed only runs the failed case");
+
+    g_fix_flaky = true;
+    results = litetest::run_tests(args);
+    check(case_names(results) == std::vector<std::string> { "HistoryFlaky" } && results.n_cases_passed == 1,
+          "rerun-failed runs the fixed case again");
+
+    results = litetest::run_tests(args);
+    check(results.n_cases_executed == 3, "rerun-failed runs every case once none failed");
+    std::filesystem::remove(args.state_file);
+}
+
+void check_cancellation() {
+    litetest::RunTestsArgs args = args_for({ "Cancellation" });
+    args.max_failures = 2;
+    litetest::RunTestsResults results = litetest::run_tests(args);
+    check(results.cancelled && results.n_cases_executed == 2 && results.n_cases_skipped == 3,
+          "max-failures cancels the run after 2 failures, skipping the other 3 cases");
+
+    args.jobs = 2;
+    args.parallel_cases = true;
+    results = litetest::run_tests(args);
+    check(results.cancelled && results.n_cases_executed + results.n_cases_skipped == 5,
+          "max-failures accounts for every case of a threaded run");
+}
+
+void check_shrinking() {
+    litetest::RunTestsArgs args = args_for({ "Shrinking" });
+    args.seed = 1;
+    litetest::RunTestsResults results = litetest::run_tests(args);
+    const litetest::CaseReport* report = find_case(results, "BelowHundred");
+    check(report && contains(report->message, "Property falsified by 100 "),
+          "a falsified property is shrunk to its least failing input");
+}
+
+void check_stress() {
+    g_stress_arrivals = 0;
+    litetest::RunTestsResults results = litetest::run_tests(args_for({ "Stress" }));
+    const litetest::CaseReport* report = find_case(results, "StressBarrier");
+    check(report && report->status == litetest::CaseStatus::PASSED && report->stress &&
+          report->stress->threads == 4 && report->stress->iterations == 50 && g_stress_arrivals == 200,
+          "stress iterations release their 4 threads together");
+}
+
+void check_isolation() {
+    litetest::RunTestsArgs args = args_for({ "Crashing", "Hanging" });
+    args.isolated = true;
+    litetest::RunTestsResults results = litetest::run_tests(args);
+    check(has_status(results, "Aborts", litetest::CaseStatus::CRASHED) &&
+          has_status(results, "AfterAbort", litetest::CaseStatus::PASSED),
+          "isolated runs report a crash and carry on in a new worker");
+    check(has_status(results, "Hangs", litetest::CaseStatus::TIMED_OUT) &&
+          has_status(results, "AfterHang", litetest::CaseStatus::PASSED),
+          "isolated runs kill a hung case and carry on in a new worker");
+}
+
+void check_reporter() {
+    litetest::RunTestsArgs args = args_for({ "History", "Output" });
+    args.reporter = "jsonl";
+    args.report_file = temp_file("report.jsonl");
+    litetest::RunTestsResults results = litetest::run_tests(args);
+
+    std::ifstream file(args.report_file);
+    int n_case_lines = 0;
+    bool has_output = false;
+    for (std::string line; std::getline(file, line);) {
+        if (contains(line, "\"event\":\"case\"")) {
+            n_case_lines++;
+        }
+        has_output = has_output || contains(line, "printed by PrintsAndFails");
+    }
+    check(n_case_lines == results.n_cases_executed, "the jsonl report has a line per case");
+    check(has_output, "the jsonl report has the output of failed cases");
+    std::filesystem::remove(args.report_file);
+}
+
+void check_capture() {
+    litetest::RunTestsArgs args = args_for({ "Output" });
+    litetest::RunTestsResults results = litetest::run_tests(args);
+    const litetest::CaseReport* report = find_case(results, "PrintsAndFails");
+    check(report && contains(report->captured_stdout, "printed by PrintsAndFails"),
+          "the output of a failed case is captured");
+
+    args.jobs = 2;
+    args.parallel_cases = true;
+    results = litetest::run_tests(args);
+    report = find_case(results, "PrintsAndFails");
+    check(report && contains(report->captured_stdout, "printed by PrintsAndFails"),
+          "the output of a failed case is captured on threads");
+}
+
+void check_stringify() {
+    litetest::RunTestsArgs args = args_for({ "Output" });
+    args.max_elements = 3;
+    litetest::RunTestsResults results = litetest::run_tests(args);
+    const litetest::CaseReport* report = find_case(results, "LongValue");
+    check(report && contains(report->message, "[7, 7, 7, … 7 more]"),
+          "failure messages only show the first elements of long containers");
+}
+
+void check_allocations() {
+    litetest::RunTestsArgs args = args_for({ "Allocations" });
+    args.track_allocations = true;
+    litetest::RunTestsResults results = litetest::run_tests(args);
+    const litetest::CaseReport* allocates = find_case(results, "AllocatesOnce");
+    const litetest::CaseReport* leaks = find_case(results, "Leaks");
+    check(allocates && allocates->status == litetest::CaseStatus::PASSED, "EXPECT_ALLOCS counts allocations");
+    check(leaks && leaks->allocations && leaks->allocations->leaked_bytes >= int64_t(16 * sizeof(int)),
+          "tracked allocations report leaks");
+}
+
+void check_fixtures() {
+    g_fixtures_built = 0;
+    g_fixtures_destroyed = 0;
+    litetest::RunTestsResults results = litetest::run_tests(args_for({ "FixtureSuite" }));
+    check(results.n_cases_passed == 2 && g_fixtures_built == 1 && g_fixtures_destroyed == 1,
+          "a suite fixture is built once for its cases and destroyed after the cleanup");
+}
+
+} // namespace
+
+int main() {
+    check_sharding();
+    check_history();
+    check_cancellation();
+    check_shrinking();
+    check_stress();
+    check_isolation();
+    check_reporter();
+    check_capture();
+    check_stringify();
+    check_allocations();
+    check_fixtures();
+
+    std::cout << (s_n_failed_checks == 0 ? "Every check passed." : "Some checks failed.") << std::endl;
+    return s_n_failed_checks == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,28 @@
+#include <litetest.h>
+
+#include "behaviors.h"
+
+std::atomic<bool> g_fix_flaky { false };
+
+TEST_SUITE(History);
+
+TEST_CASE(HistoryFirst) {
+    EXPECT(1).to_be(1);
+}
+
+TEST_CASE(HistoryFlaky) {
+    EXPECT(g_fix_flaky.load()).to_be(true); // Fails until fixed
+}
+
+TEST_CASE(HistoryLast) {
+    EXPECT(1).to_be(1);
+}
+
+TEST_SUITE(Cancellation);
+
+// Each fails, so that a run stops after RunTestsArgs::max_failures of them.
+TEST_CASE(Failing1) { EXPECT(1).to_be(2); }
+TEST_CASE(Failing2) { EXPECT(1).to_be(2); }
+TEST_CASE(Failing3) { EXPECT(1).to_be(2); }
+TEST_CASE(Failing4) { EXPECT(1).to_be(2); }
+TEST_CASE(Failing5) { EXPECT(1).to_be(2); }
@@ -0,0 +1,25 @@
+#include <litetest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+TEST_SUITE(Crashing);
+
+TEST_CASE(Aborts) {
+    std::abort();
+}
+
+TEST_CASE(AfterAbort) {
+    EXPECT(1).to_be(1);
+}
+
+TEST_SUITE(Hanging);
+
+TEST_CASE_TIMEOUT(Hangs, 200) {
+    std::this_thread::sleep_for(std::chrono::seconds(30));
+}
+
+TEST_CASE(AfterHang) {
+    EXPECT(1).to_be(1);
+}
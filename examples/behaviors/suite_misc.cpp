@@ -0,0 +1,58 @@
+#include <litetest.h>
+
+#include <iostream>
+#include <vector>
+
+#include "behaviors.h"
+
+std::atomic<int> g_fixtures_built { 0 };
+std::atomic<int> g_fixtures_destroyed { 0 };
+
+namespace {
+
+struct Dataset {
+    Dataset() : values { 1, 2, 3 } { ++g_fixtures_built; }
+    ~Dataset() { ++g_fixtures_destroyed; }
+
+    std::vector<int> values;
+};
+
+} // namespace
+
+TEST_SUITE(FixtureSuite);
+
+TEST_CASE(FixtureFirst) {
+    EXPECT(litetest::suite_fixture<Dataset>().values.size()).to_be(3u);
+}
+
+TEST_CASE(FixtureSecond) {
+    EXPECT(litetest::suite_fixture<Dataset>().values.front()).to_be(1);
+}
+
+SUITE_CLEANUP(FixtureSuite) {
+    // Fixtures outlive the cleanup.
+    EXPECT(g_fixtures_destroyed.load()).to_be(0);
+}
+
+TEST_SUITE(Allocations);
+
+TEST_CASE(AllocatesOnce) {
+    EXPECT_ALLOCS([]() { std::vector<int> values(100); }).to_be(1);
+}
+
+TEST_CASE(Leaks) {
+    int* leaked = new int[16];
+    (void)leaked;
+}
+
+TEST_SUITE(Output);
+
+TEST_CASE(PrintsAndFails) {
+    std::cout << "printed by PrintsAndFails" << std::endl;
+    EXPECT(1).to_be(2);
+}
+
+TEST_CASE(LongValue) {
+    std::vector<int> values(10, 7);
+    EXPECT(values).to_be(std::vector<int>()); // Fails, describing a cut value
+}
@@ -0,0 +1,9 @@
+#include <litetest.h>
+#include <property.h>
+
+TEST_SUITE(Shrinking);
+
+// Falsified by any value from 100 on, which shrinking should narrow down to 100.
+PROPERTY_CASE(BelowHundred, litetest::gen::integers<int>(0, 1000000)) {
+    EXPECT(param < 100).to_be(true);
+}
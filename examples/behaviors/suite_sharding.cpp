@@ -0,0 +1,21 @@
+#include <litetest.h>
+
+// Suites given known durations by the driver, to be split into shards.
+
+TEST_SUITE(ShardA);
+TEST_CASE(CaseA) { EXPECT(1).to_be(1); }
+
+TEST_SUITE(ShardB);
+TEST_CASE(CaseB) { EXPECT(1).to_be(1); }
+
+TEST_SUITE(ShardC);
+TEST_CASE(CaseC) { EXPECT(1).to_be(1); }
+
+TEST_SUITE(ShardD);
+TEST_CASE(CaseD) { EXPECT(1).to_be(1); }
+
+TEST_SUITE(ShardE);
+TEST_CASE(CaseE) { EXPECT(1).to_be(1); }
+
+TEST_SUITE(ShardF);
+TEST_CASE(CaseF) { EXPECT(1).to_be(1); }
@@ -0,0 +1,22 @@
+#include <litetest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "behaviors.h"
+
+std::atomic<int> g_stress_arrivals { 0 };
+
+TEST_SUITE(Stress);
+
+// Waits for the other threads of its iteration, which only all arrive if
+// they're released together.
+TEST_CASE_STRESS(StressBarrier, 4, 50) {
+    int arrival = ++g_stress_arrivals;
+    int iteration_end = (arrival + 3) / 4 * 4;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (g_stress_arrivals.load() < iteration_end && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+    EXPECT(g_stress_arrivals.load() >= iteration_end).to_be(true);
+}
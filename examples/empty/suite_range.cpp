@@ -0,0 +1,28 @@
+#include <litetest.h>
+#include <bulk.h>
+
+#include <limits>
+#include <vector>
+
+TEST_SUITE(SuiteRange);
+
+// 5 floats: the first 4 are compared with SIMD where available, the last one on its own.
+
+TEST_CASE(CaseNearEqualInfinities) {
+    float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> result { 1.0f, inf, 3.0f, 4.0f, -inf };
+    std::vector<float> expected { 1.0f, inf, 3.0f, 4.0f, -inf };
+    EXPECT_RANGE(result).to_be_near(expected, 0, 1e-6); // Success expected
+}
+
+TEST_CASE(CaseNearInfinity) {
+    std::vector<float> result { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f };
+    std::vector<float> expected { 1.0f, std::numeric_limits<float>::infinity(), 3.0f, 4.0f, 5.0f };
+    EXPECT_RANGE(result).to_be_near(expected, 0, 1e-6); // Fail expected
+}
+
+TEST_CASE(CaseNearNaN) {
+    std::vector<double> result { 1.0, 2.0, 3.0, 4.0, 5.0 };
+    std::vector<double> expected { 1.0, 2.0, 3.0, 4.0, std::numeric_limits<double>::quiet_NaN() };
+    EXPECT_RANGE(result).to_be_near(expected, 1.0, 1e-6); // Fail expected
+}
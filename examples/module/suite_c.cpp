@@ -0,0 +1,7 @@
+#include <litetest.h>
+
+TEST_SUITE(SuiteC);
+
+TEST_CASE(CaseC) {
+    EXPECT(1 + 1).to_be(2); // Success expected
+}
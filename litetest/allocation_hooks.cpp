@@ -0,0 +1,168 @@
+#include "internal.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions to count, per thread, what test
+// cases allocate. Built into the programs linking the litetest_allocs
+// target, so that others don't pay for the counting.
+//
+// Every overload is replaced, as a set: a block allocated by one overload
+// may be freed by any other, and each needs the header ours put before it.
+// Programs with replacements of their own therefore can't link this too.
+
+namespace litetest::internal {
+
+namespace {
+
+/**
+ * Stored right before each block, to know its size when it is freed.
+ * Its alignment keeps blocks following it suitably aligned.
+ */
+struct alignas(alignof(std::max_align_t)) BlockHeader {
+    size_t size;
+    void* raw;
+};
+
+void* allocate(size_t size, size_t alignment, bool nothrow) {
+    size_t padding = alignment > alignof(BlockHeader) ? alignment : 0;
+    size_t total = sizeof(BlockHeader) + size + padding;
+    auto raw = static_cast<char*>(std::malloc(total));
+    // Like the standard operator new, retry through the new handler.
+    while (!raw) {
+        std::new_handler handler = std::get_new_handler();
+        try {
+            if (!handler) {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+        catch (const std::bad_alloc&) {
+            if (nothrow) {
+                return nullptr;
+            }
+            throw;
+        }
+        raw = static_cast<char*>(std::malloc(total));
+    }
+    uintptr_t user = uintptr_t(raw) + sizeof(BlockHeader);
+    if (padding) {
+        user = (user + alignment - 1) & ~uintptr_t(alignment - 1);
+    }
+    auto header = reinterpret_cast<BlockHeader*>(user) - 1;
+    header->size = size;
+    header->raw = raw;
+
+    AllocationCounters& counters = t_allocations;
+    counters.count++;
+    counters.bytes += int64_t(size);
+    counters.live_bytes += int64_t(size);
+    counters.peak_live_bytes = std::max(counters.peak_live_bytes, counters.live_bytes);
+    return reinterpret_cast<void*>(user);
+}
+
+void deallocate(void* ptr) noexcept {
+    if (!ptr) {
+        return;
+    }
+    auto header = static_cast<BlockHeader*>(ptr) - 1;
+    // Blocks freed by another thread than the one which allocated them
+    // make live bytes drift per thread, but cases only look at differences.
+    t_allocations.live_bytes -= int64_t(header->size);
+    std::free(header->raw);
+}
+
+constexpr size_t DEFAULT_ALIGNMENT = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+const bool s_installed = (g_allocation_hooks = true);
+
+} // namespace
+
+} // litetest::internal
+
+using litetest::internal::allocate;
+using litetest::internal::deallocate;
+using litetest::internal::DEFAULT_ALIGNMENT;
+
+void* operator new(size_t size) {
+    return allocate(size, DEFAULT_ALIGNMENT, false);
+}
+
+void* operator new[](size_t size) {
+    return allocate(size, DEFAULT_ALIGNMENT, false);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, DEFAULT_ALIGNMENT, true);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, DEFAULT_ALIGNMENT, true);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return allocate(size, size_t(alignment), false);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return allocate(size, size_t(alignment), false);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, size_t(alignment), true);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, size_t(alignment), true);
+}
+
+void operator delete(void* ptr) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
@@ -0,0 +1,22 @@
+#include "runner.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace litetest::internal {
+
+thread_local AllocationCounters t_allocations {};
+
+bool g_allocation_hooks = false;
+
+AllocationStats allocations_since(const AllocationCounters& start) {
+    const AllocationCounters& now = t_allocations;
+    AllocationStats stats;
+    stats.allocations = now.count - start.count;
+    stats.bytes = now.bytes - start.bytes;
+    stats.peak_bytes = std::max<int64_t>(0, now.peak_live_bytes - start.live_bytes);
+    stats.leaked_bytes = std::max<int64_t>(0, now.live_bytes - start.live_bytes);
+    return stats;
+}
+
+} // litetest::internal
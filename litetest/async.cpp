@@ -0,0 +1,454 @@
+#include "async.h"
+#include "runner.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace litetest::internal {
+
+#ifdef __linux__
+
+namespace {
+
+/** Cases of a batch in flight at once, bounding the descriptors they hold. */
+constexpr size_t MAX_CASES_IN_FLIGHT = 256;
+
+/** Interval at which children are polled where pidfds aren't supported. */
+constexpr double CHILD_POLL_INTERVAL = 0.005;
+
+/** An asynchronous case in flight. */
+struct AsyncRun {
+    TestCase* test_case;
+    AsyncCoroutine coroutine;
+    ExecutionContext context;
+    CaseResult result;
+    Clock::time_point start;
+    std::optional<Clock::time_point> deadline;
+    double limit_seconds = 0;
+    double cpu_seconds = 0;
+    int64_t n_assertions = 0;
+};
+
+/** Something an asynchronous case is suspended on. */
+struct Wait {
+    AsyncRun* run;
+    AsyncWaiter waiter;
+
+    /** Descriptor registered with epoll, owned by the wait. */
+    int fd = -1;
+
+    /** Child to reap once fd, its pidfd, is readable or, without pidfd, when polled. */
+    int pid = 0;
+    int* status = nullptr;
+
+    std::optional<std::multimap<Clock::time_point, uint64_t>::iterator> timer;
+};
+
+int open_pidfd(int pid) {
+#ifdef SYS_pidfd_open
+    return int(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void) pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Runs the coroutines of asynchronous cases on the calling thread, resuming
+ * each when what it awaits happens. Every resumption runs in its case's
+ * execution context, so that assertions and failures are attributed to it.
+ */
+class EventLoop {
+public:
+    EventLoop(const RunTestsArgs& args,
+              const CancellationToken* cancellation,
+              const std::function<void(const CaseResult&)>& finished,
+              Watchdog* watchdog)
+        : m_args(args), m_cancellation(cancellation), m_finished(finished), m_watchdog(watchdog),
+          m_epoll(epoll_create1(EPOLL_CLOEXEC)) {
+        if (m_epoll < 0) {
+            throw std::runtime_error(std::string("Failed to create an event loop: ") + std::strerror(errno));
+        }
+    }
+
+    ~EventLoop() {
+        close(m_epoll);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void run(TestSuite* suite, const std::vector<TestCase*>& cases) {
+        std::deque<TestCase*> queued(cases.begin(), cases.end());
+        bool first = true;
+        while (true) {
+            // The caller checked for cancellation before the first case.
+            while (!queued.empty() && m_runs.size() < MAX_CASES_IN_FLIGHT &&
+                   (first || !(m_cancellation && m_cancellation->cancelled()))) {
+                start(suite, queued.front());
+                queued.pop_front();
+                first = false;
+            }
+            if (m_runs.empty()) {
+                return;
+            }
+            if (m_waits.empty()) {
+                // Nothing left to resume the cases in flight.
+                while (!m_runs.empty()) {
+                    AsyncRun& run = *m_runs.begin()->second;
+                    run.result.status = CaseStatus::INCOMPLETE;
+                    run.result.message = "Suspended on something other than a litetest awaitable, "
+                                         "which nothing can resume.";
+                    abort(run);
+                }
+                continue;
+            }
+            poll();
+        }
+    }
+
+    void wait_for(double seconds, AsyncWaiter waiter) {
+        add_timer(add_wait(waiter), seconds);
+    }
+
+    void wait_fd(int fd, bool writable, AsyncWaiter waiter) {
+        // Each wait registers its own duplicate, as a descriptor can only be
+        // registered once and several cases may wait on the same one.
+        int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (dup_fd < 0) {
+            throw std::runtime_error("Failed to wait on fd " + std::to_string(fd) + ": " + std::strerror(errno));
+        }
+        add_fd(add_wait(waiter), dup_fd, writable ? EPOLLOUT : EPOLLIN);
+    }
+
+    void wait_child(int pid, int* status, AsyncWaiter waiter) {
+        uint64_t id = add_wait(waiter);
+        m_waits[id].pid = pid;
+        m_waits[id].status = status;
+        int pidfd = open_pidfd(pid);
+        if (pidfd >= 0) {
+            add_fd(id, pidfd, EPOLLIN);
+        }
+        else {
+            add_timer(id, 0);
+        }
+    }
+
+    /** Case being resumed, if any. */
+    AsyncRun* current() const { return m_current; }
+
+private:
+    /** Adds a wait of the case being resumed, returning its id. */
+    uint64_t add_wait(AsyncWaiter waiter) {
+        uint64_t id = m_next_wait_id++;
+        Wait& wait = m_waits[id];
+        wait.run = m_current;
+        wait.waiter = waiter;
+        return id;
+    }
+
+    void add_timer(uint64_t id, double seconds) {
+        auto delay = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        m_waits[id].timer = m_timers.emplace(Clock::now() + delay, id);
+    }
+
+    void add_fd(uint64_t id, int fd, uint32_t events) {
+        m_waits[id].fd = fd;
+        epoll_event event {};
+        event.events = events;
+        event.data.u64 = id;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            int error = errno;
+            remove_wait(id);
+            throw std::runtime_error(std::string("Failed to wait on a descriptor: ") + std::strerror(error));
+        }
+    }
+
+    void remove_wait(uint64_t id) {
+        auto it = m_waits.find(id);
+        if (it == m_waits.end()) {
+            return;
+        }
+        Wait& wait = it->second;
+        if (wait.fd >= 0) {
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, wait.fd, nullptr);
+            close(wait.fd);
+        }
+        if (wait.timer) {
+            m_timers.erase(*wait.timer);
+        }
+        m_waits.erase(it);
+    }
+
+    void start(TestSuite* suite, TestCase* test_case) {
+        auto run = std::make_unique<AsyncRun>();
+        run->test_case = test_case;
+        run->context.suite = suite;
+        run->context.test_case = test_case;
+        run->context.parent = t_context;
+        run->context.cancellation = m_cancellation;
+        run->context.args = &m_args;
+        run->context.worker = std::this_thread::get_id();
+        run->result.suite = suite;
+        run->result.test_case = test_case;
+        run->start = Clock::now();
+        run->limit_seconds = case_time_limit(*test_case, m_args);
+        if (run->limit_seconds > 0) {
+            run->deadline = run->start + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(run->limit_seconds));
+        }
+
+        AsyncRun& started = *run;
+        m_runs.emplace(&started, std::move(run));
+        try {
+            ContextScope scope(&started.context);
+            started.coroutine = test_case->start_async();
+        }
+        catch (const std::exception& e) {
+            started.result.status = CaseStatus::INCOMPLETE;
+            started.result.message = e.what();
+            finish(started);
+            return;
+        }
+        resume(started, AsyncWaiter { started.coroutine.resume, started.coroutine.frame });
+    }
+
+    void resume(AsyncRun& run, AsyncWaiter waiter) {
+        {
+            // The loop can't interrupt a case that blocks instead of
+            // suspending, so the watchdog takes over until it suspends.
+            WatchScope watch(m_watchdog, run.context.suite, run.test_case, run.limit_seconds, run.start);
+            ContextScope scope(&run.context);
+            m_current = &run;
+            int64_t initial_assertion_count = t_assertions.count;
+            double initial_cpu_seconds = thread_cpu_seconds();
+            waiter.resume(waiter.frame);
+            run.n_assertions += t_assertions.count - initial_assertion_count;
+            run.cpu_seconds += thread_cpu_seconds() - initial_cpu_seconds;
+            m_current = nullptr;
+        }
+        if (run.coroutine.done(run.coroutine.frame)) {
+            try {
+                run.coroutine.rethrow(run.coroutine.frame);
+                run.context.rethrow_helper_failure();
+            }
+            catch (const TestFailure& test_failure) {
+                run.result.status = CaseStatus::FAILED;
+                run.result.message = test_failure.what();
+                run.result.line = test_failure.line;
+            }
+            catch (const std::exception& e) {
+                run.result.status = CaseStatus::INCOMPLETE;
+                run.result.message = e.what();
+            }
+            catch (...) {
+                run.result.status = CaseStatus::INCOMPLETE;
+                run.result.message = "Threw an exception not derived from std::exception.";
+            }
+            finish(run);
+        }
+    }
+
+    /** Destroys a case's coroutine before it completes, with the result set. */
+    void abort(AsyncRun& run) {
+        // Destroying the frame runs destructors of the case's locals.
+        ContextScope scope(&run.context);
+        finish(run);
+    }
+
+    void finish(AsyncRun& run) {
+        std::vector<uint64_t> waits;
+        for (const auto& [id, wait]: m_waits) {
+            if (wait.run == &run) {
+                waits.push_back(id);
+            }
+        }
+        for (uint64_t id: waits) {
+            remove_wait(id);
+        }
+        if (run.coroutine.frame) {
+            run.coroutine.destroy(run.coroutine.frame);
+        }
+        run.result.time = { seconds_since(run.start), run.cpu_seconds };
+        run.result.n_assertions = int(run.n_assertions + run.context.helper_assertions);
+        run.result.n_checks_skipped = run.context.skipped_checks;
+        CaseResult result = std::move(run.result);
+        m_runs.erase(&run);
+        m_finished(result);
+    }
+
+    /** Waits for events, then resumes the cases waiting on them. */
+    void poll() {
+        Clock::time_point now = Clock::now();
+        std::optional<Clock::time_point> next;
+        if (!m_timers.empty()) {
+            next = m_timers.begin()->first;
+        }
+        for (const auto& [run, owned]: m_runs) {
+            if (run->deadline && (!next || *run->deadline < *next)) {
+                next = run->deadline;
+            }
+        }
+        int timeout_ms = -1;
+        if (next) {
+            double seconds = std::max(0.0, std::chrono::duration<double>(*next - now).count());
+            timeout_ms = int(std::min(std::ceil(seconds * 1000), 60000.0));
+        }
+
+        epoll_event events[64];
+        int n_events = epoll_wait(m_epoll, events, 64, timeout_ms);
+        if (n_events < 0 && errno != EINTR) {
+            throw std::runtime_error(std::string("Failed to wait for events: ") + std::strerror(errno));
+        }
+        for (int i = 0; i < n_events; ++i) {
+            fire(events[i].data.u64);
+        }
+
+        now = Clock::now();
+        std::vector<uint64_t> expired;
+        for (auto it = m_timers.begin(); it != m_timers.end() && it->first <= now; ++it) {
+            expired.push_back(it->second);
+        }
+        for (uint64_t id: expired) {
+            fire(id);
+        }
+
+        std::vector<AsyncRun*> timed_out;
+        for (const auto& [run, owned]: m_runs) {
+            if (run->deadline && *run->deadline <= now) {
+                timed_out.push_back(run);
+            }
+        }
+        for (AsyncRun* run: timed_out) {
+            if (m_runs.count(run)) {
+                run->result.status = CaseStatus::TIMED_OUT;
+                run->result.message = "Timed out after " + format_ms(seconds_since(run->start)) +
+                                      " (limit of " + format_ms(run->limit_seconds) + ").";
+                abort(*run);
+            }
+        }
+    }
+
+    void fire(uint64_t id) {
+        auto it = m_waits.find(id);
+        // Waits of a case that finished in the meantime are gone.
+        if (it == m_waits.end()) {
+            return;
+        }
+        Wait wait = it->second;
+        if (wait.pid) {
+            pid_t reaped = waitpid(wait.pid, wait.status, WNOHANG);
+            if (reaped == 0 && wait.fd < 0) {
+                // Not exited yet: poll again later.
+                m_timers.erase(*it->second.timer);
+                auto delay = std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(CHILD_POLL_INTERVAL));
+                it->second.timer = m_timers.emplace(Clock::now() + delay, id);
+                return;
+            }
+            if (reaped < 0) {
+                *wait.status = -1;
+            }
+        }
+        remove_wait(id);
+        resume(*wait.run, wait.waiter);
+    }
+
+    const RunTestsArgs& m_args;
+    const CancellationToken* m_cancellation;
+    const std::function<void(const CaseResult&)>& m_finished;
+    Watchdog* m_watchdog;
+    int m_epoll;
+
+    std::map<AsyncRun*, std::unique_ptr<AsyncRun>> m_runs;
+    std::map<uint64_t, Wait> m_waits;
+    std::multimap<Clock::time_point, uint64_t> m_timers;
+    uint64_t m_next_wait_id = 1;
+    AsyncRun* m_current = nullptr;
+};
+
+thread_local EventLoop* t_loop = nullptr;
+
+EventLoop& current_loop() {
+    if (!t_loop || !t_loop->current()) {
+        throw std::logic_error("litetest awaitables can only be awaited by asynchronous test cases.");
+    }
+    return *t_loop;
+}
+
+} // namespace
+
+void async_wait_for(double seconds, AsyncWaiter waiter) {
+    current_loop().wait_for(seconds, waiter);
+}
+
+void async_wait_fd(int fd, bool writable, AsyncWaiter waiter) {
+    current_loop().wait_fd(fd, writable, waiter);
+}
+
+void async_wait_child(int pid, int* status, AsyncWaiter waiter) {
+    current_loop().wait_child(pid, status, waiter);
+}
+
+void execute_async_cases(TestSuite* suite,
+                         const std::vector<TestCase*>& cases,
+                         const RunTestsArgs& args,
+                         const CancellationToken* cancellation,
+                         const std::function<void(const CaseResult&)>& finished,
+                         Watchdog* watchdog) {
+    EventLoop loop(args, cancellation, finished, watchdog);
+    EventLoop* previous = t_loop;
+    t_loop = &loop;
+    try {
+        loop.run(suite, cases);
+    }
+    catch (...) {
+        t_loop = previous;
+        throw;
+    }
+    t_loop = previous;
+}
+
+#else
+
+[[noreturn]] static void throw_unsupported() {
+    throw std::runtime_error("Asynchronous test cases are only supported on Linux.");
+}
+
+void async_wait_for(double, AsyncWaiter) {
+    throw_unsupported();
+}
+
+void async_wait_fd(int, bool, AsyncWaiter) {
+    throw_unsupported();
+}
+
+void async_wait_child(int, int*, AsyncWaiter) {
+    throw_unsupported();
+}
+
+void execute_async_cases(TestSuite*,
+                         const std::vector<TestCase*>&,
+                         const RunTestsArgs&,
+                         const CancellationToken*,
+                         const std::function<void(const CaseResult&)>&,
+                         Watchdog*) {
+    throw_unsupported();
+}
+
+#endif // __linux__
+
+} // litetest::internal
@@ -0,0 +1,255 @@
+#ifndef LITETEST_ASYNC_H
+#define LITETEST_ASYNC_H
+
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <utility>
+
+#include "internal.h"
+
+namespace litetest::internal {
+
+/** Resumes a coroutine suspended on the event loop of asynchronous cases. */
+struct AsyncWaiter {
+    void (*resume)(void* frame);
+    void* frame;
+};
+
+// Suspend the calling asynchronous case until something happens, then
+// resume 'waiter' from the event loop. Throw std::logic_error outside of
+// asynchronous cases.
+
+/** Until 'seconds' have elapsed. */
+void async_wait_for(double seconds, AsyncWaiter waiter);
+
+/** Until 'fd' is readable, or writable if 'writable' is true. */
+void async_wait_fd(int fd, bool writable, AsyncWaiter waiter);
+
+/** Until child process 'pid' exits, reaping it and storing its wait status in 'status'. */
+void async_wait_child(int pid, int* status, AsyncWaiter waiter);
+
+} // litetest::internal
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define LITETEST_HAS_COROUTINES 1
+#endif
+#endif
+
+#ifdef LITETEST_HAS_COROUTINES
+
+#include <coroutine>
+
+namespace litetest {
+
+namespace internal {
+
+inline void resume_frame(void* frame) {
+    std::coroutine_handle<>::from_address(frame).resume();
+}
+
+template <typename T>
+struct TaskResult {
+    std::optional<T> value;
+
+    void return_value(T result) { value = std::move(result); }
+
+    T take() { return std::move(*value); }
+};
+
+template <>
+struct TaskResult<void> {
+    void return_void() {}
+
+    void take() {}
+};
+
+} // internal
+
+/**
+ * Coroutine returning a T, run on the event loop of asynchronous cases.
+ * The body of a TEST_CASE_ASYNC() is a Task<>, and may co_await other
+ * tasks as well as sleep_for(), readable(), writable() and child_exit().
+ * Tasks only start once awaited.
+ */
+template <typename T = void>
+class [[nodiscard]] Task {
+public:
+    struct promise_type : internal::TaskResult<T> {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        Task get_return_object() { return Task(Handle::from_promise(*this)); }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        auto final_suspend() noexcept {
+            // Resumes whoever awaited the task, if anyone.
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    std::coroutine_handle<> continuation = handle.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+            return FinalAwaiter {};
+        }
+
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task(Task&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, {})) {}
+
+    ~Task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task& operator=(Task&&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+
+    T await_resume() {
+        if (m_handle.promise().error) {
+            std::rethrow_exception(m_handle.promise().error);
+        }
+        return m_handle.promise().take();
+    }
+
+    /** Hands the coroutine over to the caller, who becomes responsible for destroying it. */
+    Handle release() { return std::exchange(m_handle, {}); }
+
+private:
+    explicit Task(Handle handle)
+        : m_handle(handle) {}
+
+    Handle m_handle;
+};
+
+namespace internal {
+
+/** Wraps the coroutine of a TEST_CASE_ASYNC() for the runner. */
+inline AsyncCoroutine make_async_coroutine(Task<> task) {
+    using Handle = Task<>::Handle;
+    AsyncCoroutine coroutine;
+    coroutine.frame = task.release().address();
+    coroutine.resume = resume_frame;
+    coroutine.done = [](void* frame) { return Handle::from_address(frame).done(); };
+    coroutine.rethrow = [](void* frame) {
+        if (std::exception_ptr error = Handle::from_address(frame).promise().error) {
+            std::rethrow_exception(error);
+        }
+    };
+    coroutine.destroy = [](void* frame) { Handle::from_address(frame).destroy(); };
+    return coroutine;
+}
+
+/** Awaitable suspending through one of the async_wait_*() functions. */
+template <typename Wait, typename Result = void>
+struct LoopAwaiter {
+    Wait wait;
+    Result result {};
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        wait(AsyncWaiter { resume_frame, handle.address() }, result);
+    }
+
+    Result await_resume() const { return result; }
+};
+
+template <typename Wait>
+struct LoopAwaiter<Wait, void> {
+    Wait wait;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        wait(AsyncWaiter { resume_frame, handle.address() });
+    }
+
+    void await_resume() const noexcept {}
+};
+
+template <typename Result, typename Wait>
+LoopAwaiter<Wait, Result> loop_awaiter(Wait wait) {
+    return { std::move(wait) };
+}
+
+} // internal
+
+/** Resumes the awaiting case after 'duration'. */
+template <typename Rep, typename Period>
+auto sleep_for(std::chrono::duration<Rep, Period> duration) {
+    double seconds = std::chrono::duration<double>(duration).count();
+    return internal::loop_awaiter<void>([seconds](internal::AsyncWaiter waiter) {
+        internal::async_wait_for(seconds, waiter);
+    });
+}
+
+/** Resumes the awaiting case once 'fd' is readable. */
+inline auto readable(int fd) {
+    return internal::loop_awaiter<void>([fd](internal::AsyncWaiter waiter) {
+        internal::async_wait_fd(fd, false, waiter);
+    });
+}
+
+/** Resumes the awaiting case once 'fd' is writable. */
+inline auto writable(int fd) {
+    return internal::loop_awaiter<void>([fd](internal::AsyncWaiter waiter) {
+        internal::async_wait_fd(fd, true, waiter);
+    });
+}
+
+/** Resumes the awaiting case once child process 'pid' exits. Yields its wait status. */
+inline auto child_exit(int pid) {
+    return internal::loop_awaiter<int>([pid](internal::AsyncWaiter waiter, int& status) {
+        internal::async_wait_child(pid, &status, waiter);
+    });
+}
+
+/**
+ * Defines an asynchronous test case: a coroutine which may co_await
+ * litetest::sleep_for(), readable(), writable(), child_exit() and other
+ * litetest::Task<>s. Consecutive asynchronous cases of a suite run
+ * concurrently on a single-threaded event loop. Assertions and time limits
+ * work as for other cases; a case exceeding its limit is destroyed at its
+ * current suspension point. A case blocking without suspending, e.g. on a
+ * synchronous read(), stalls every other case of the loop, and if it runs
+ * past its limit, abandons the run like a hung synchronous case would.
+ * Requires C++20 and Linux.
+ *
+ * Usage: TEST_CASE_ASYNC(your_case_name) {
+ *      co_await litetest::readable(server_fd);
+ *      EXPECT(read_reply(server_fd)).to_be("pong");
+ * }
+ */
+#define TEST_CASE_ASYNC(name) \
+    static litetest::Task<> case_##name(); \
+    static litetest::internal::AsyncCoroutine start_##name() { \
+        return litetest::internal::make_async_coroutine(case_##name()); \
+    } \
+    static litetest::internal::CaseRegistration s_case_##name(#name, start_##name, __FILE__, __LINE__); \
+    static litetest::Task<> case_##name()
+
+} // litetest
+
+#endif // LITETEST_HAS_COROUTINES
+
+#endif // LITETEST_ASYNC_H
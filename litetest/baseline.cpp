@@ -0,0 +1,307 @@
+#include "runner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace litetest::internal {
+
+std::string benchmark_key(const std::string& suite, const std::string& name) {
+    return suite + "." + name;
+}
+
+namespace {
+
+/**
+ * Reads the subset of JSON written by save_baseline(). Unknown
+ * object members are skipped, so the format can grow.
+ */
+class JsonReader {
+public:
+    explicit JsonReader(std::string text)
+        : m_text(std::move(text)) {}
+
+    void expect(char c) {
+        if (!consume(c)) {
+            fail(std::string("expected '") + c + "'");
+        }
+    }
+
+    bool consume(char c) {
+        skip_whitespace();
+        if (m_pos < m_text.size() && m_text[m_pos] == c) {
+            m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    std::string read_string() {
+        expect('"');
+        std::string str;
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            char c = m_text[m_pos++];
+            if (c == '\\' && m_pos < m_text.size()) {
+                char escaped = m_text[m_pos++];
+                switch (escaped) {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'u':
+                        // Only emitted by us for control characters.
+                        c = char(std::stoi(m_text.substr(m_pos, 4), nullptr, 16));
+                        m_pos += 4;
+                        break;
+                    default: c = escaped; break;
+                }
+            }
+            str += c;
+        }
+        expect('"');
+        return str;
+    }
+
+    double read_number() {
+        skip_whitespace();
+        const char* begin = m_text.c_str() + m_pos;
+        char* end = nullptr;
+        double value = std::strtod(begin, &end);
+        if (end == begin) {
+            fail("expected a number");
+        }
+        m_pos += size_t(end - begin);
+        return value;
+    }
+
+    void skip_value() {
+        skip_whitespace();
+        if (m_pos >= m_text.size()) {
+            fail("unexpected end of file");
+        }
+        char c = m_text[m_pos];
+        if (c == '"') {
+            read_string();
+        }
+        else if (c == '{' || c == '[') {
+            char close = c == '{' ? '}' : ']';
+            m_pos++;
+            if (consume(close)) {
+                return;
+            }
+            do {
+                if (c == '{') {
+                    read_string();
+                    expect(':');
+                }
+                skip_value();
+            } while (consume(','));
+            expect(close);
+        }
+        else if (c == '-' || (c >= '0' && c <= '9')) {
+            read_number();
+        }
+        else {
+            // true, false or null.
+            while (m_pos < m_text.size() && std::isalpha((unsigned char) m_text[m_pos])) {
+                m_pos++;
+            }
+        }
+    }
+
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error("Malformed baseline file, " + what +
+                                 " at offset " + std::to_string(m_pos) + ".");
+    }
+
+private:
+    void skip_whitespace() {
+        while (m_pos < m_text.size() && std::isspace((unsigned char) m_text[m_pos])) {
+            m_pos++;
+        }
+    }
+
+    std::string m_text;
+    size_t m_pos = 0;
+};
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+} // namespace
+
+Baseline load_baseline(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open baseline file '" + path + "'.");
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+
+    // { "benchmarks": [ { "suite": ..., "name": ..., "samples_ns": [...] }, ... ] }
+    Baseline baseline;
+    JsonReader reader(contents.str());
+    reader.expect('{');
+    if (reader.consume('}')) {
+        return baseline;
+    }
+    do {
+        std::string member = reader.read_string();
+        reader.expect(':');
+        if (member != "benchmarks") {
+            reader.skip_value();
+            continue;
+        }
+
+        reader.expect('[');
+        if (reader.consume(']')) {
+            continue;
+        }
+        do {
+            std::string suite;
+            std::string name;
+            std::vector<double> samples;
+
+            reader.expect('{');
+            if (!reader.consume('}')) {
+                do {
+                    std::string field = reader.read_string();
+                    reader.expect(':');
+                    if (field == "suite") {
+                        suite = reader.read_string();
+                    }
+                    else if (field == "name") {
+                        name = reader.read_string();
+                    }
+                    else if (field == "samples_ns") {
+                        reader.expect('[');
+                        if (!reader.consume(']')) {
+                            do {
+                                samples.push_back(reader.read_number());
+                            } while (reader.consume(','));
+                            reader.expect(']');
+                        }
+                    }
+                    else {
+                        reader.skip_value();
+                    }
+                } while (reader.consume(','));
+                reader.expect('}');
+            }
+            baseline[benchmark_key(suite, name)] = std::move(samples);
+        } while (reader.consume(','));
+        reader.expect(']');
+    } while (reader.consume(','));
+    reader.expect('}');
+    return baseline;
+}
+
+void save_baseline(const std::string& path, const RunTestsResults& results) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open baseline file '" + path + "' for writing.");
+    }
+
+    file << std::setprecision(std::numeric_limits<double>::max_digits10);
+    file << "{\n  \"benchmarks\": [";
+    bool first = true;
+    for (const CaseReport& report: results.cases) {
+        if (!report.benchmark) {
+            continue;
+        }
+        const BenchmarkStats& stats = *report.benchmark;
+
+        std::string suite;
+        std::string name;
+        append_json_string(suite, report.suite);
+        append_json_string(name, report.name);
+
+        file << (first ? "\n" : ",\n") << "    {\n      \"suite\": " << suite;
+        file << ",\n      \"name\": " << name;
+        file << ",\n      \"iterations\": " << stats.iterations;
+        file << ",\n      \"median_ns\": " << stats.median_ns;
+        file << ",\n      \"samples_ns\": [";
+        for (size_t i = 0; i < stats.sample_ns.size(); ++i) {
+            file << (i ? ", " : "") << stats.sample_ns[i];
+        }
+        file << "]\n    }";
+        first = false;
+    }
+    file << "\n  ]\n}\n";
+}
+
+double mann_whitney_p_value(const std::vector<double>& a, const std::vector<double>& b) {
+    size_t n1 = a.size();
+    size_t n2 = b.size();
+    if (n1 == 0 || n2 == 0) {
+        return 1;
+    }
+
+    // Rank both samples together, giving tied values their average rank.
+    std::vector<std::pair<double, bool>> all;
+    for (double x: a) {
+        all.emplace_back(x, true);
+    }
+    for (double x: b) {
+        all.emplace_back(x, false);
+    }
+    std::sort(all.begin(), all.end());
+
+    double rank_sum_a = 0;
+    double tie_term = 0;
+    size_t n = all.size();
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && all[j].first == all[i].first) {
+            j++;
+        }
+        double rank = double(i + j + 1) / 2;
+        for (size_t k = i; k < j; ++k) {
+            if (all[k].second) {
+                rank_sum_a += rank;
+            }
+        }
+        double t = double(j - i);
+        tie_term += t * t * t - t;
+        i = j;
+    }
+
+    // Normal approximation of U, with tie and continuity corrections.
+    double u = rank_sum_a - double(n1 * (n1 + 1)) / 2;
+    double mean_u = double(n1 * n2) / 2;
+    double var_u = double(n1 * n2) / 12 * (double(n + 1) - tie_term / double(n * (n - 1)));
+    if (var_u <= 0) {
+        return 1;
+    }
+    double z = (std::abs(u - mean_u) - 0.5) / std::sqrt(var_u);
+    if (z < 0) {
+        return 1;
+    }
+    return std::erfc(z / std::sqrt(2.0));
+}
+
+BaselineComparison compare_to_baseline(const BenchmarkStats& stats,
+                                       const std::vector<double>& baseline_samples,
+                                       double threshold,
+                                       double alpha) {
+    BaselineComparison comparison;
+    comparison.baseline_median_ns = median(baseline_samples);
+    comparison.change = comparison.baseline_median_ns > 0
+        ? stats.median_ns / comparison.baseline_median_ns - 1
+        : 0;
+    comparison.p_value = mann_whitney_p_value(stats.sample_ns, baseline_samples);
+    comparison.regression = comparison.change > threshold && comparison.p_value < alpha;
+    return comparison;
+}
+
+} // litetest::internal
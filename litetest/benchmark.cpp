@@ -0,0 +1,70 @@
+#include "runner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace litetest::internal {
+
+void use_char_pointer(const volatile char*) {}
+
+static double time_iterations(const std::function<void()>& fn, int64_t iterations) {
+    Clock::time_point start = Clock::now();
+    for (int64_t i = 0; i < iterations; ++i) {
+        fn();
+    }
+    return seconds_since(start);
+}
+
+BenchmarkStats measure_benchmark(const std::function<void()>& fn,
+                                 double sample_seconds,
+                                 int n_samples) {
+    constexpr int64_t MAX_ITERATIONS = 1'000'000'000;
+
+    // Find how many iterations it takes to fill a sample. This also
+    // warms up caches and branch predictors before measuring.
+    int64_t iterations = 1;
+    while (iterations < MAX_ITERATIONS) {
+        double elapsed = time_iterations(fn, iterations);
+        if (elapsed >= sample_seconds) {
+            break;
+        }
+
+        // Extrapolate from significant measurements, otherwise grow tenfold.
+        // Overshoot a little so we don't fall just short of the target.
+        double multiplier = elapsed > sample_seconds / 10
+            ? sample_seconds * 1.4 / elapsed
+            : 10.0;
+        int64_t next = int64_t(std::ceil(double(iterations) * multiplier));
+        iterations = std::min(MAX_ITERATIONS, std::max(next, iterations + 1));
+    }
+
+    BenchmarkStats stats;
+    stats.iterations = iterations;
+    for (int i = 0; i < std::max(1, n_samples); ++i) {
+        stats.sample_ns.push_back(time_iterations(fn, iterations) * 1e9 / double(iterations));
+    }
+
+    std::vector<double> sorted = stats.sample_ns;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+
+    stats.min_ns = sorted.front();
+    stats.median_ns = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+
+    double sum = 0;
+    for (double ns: sorted) {
+        sum += ns;
+    }
+    stats.mean_ns = sum / double(n);
+
+    double squares = 0;
+    for (double ns: sorted) {
+        squares += (ns - stats.mean_ns) * (ns - stats.mean_ns);
+    }
+    stats.stddev_ns = n > 1 ? std::sqrt(squares / double(n - 1)) : 0;
+    stats.ops_per_second = stats.mean_ns > 0 ? 1e9 / stats.mean_ns : 0;
+    return stats;
+}
+
+} // litetest::internal
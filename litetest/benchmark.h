@@ -0,0 +1,73 @@
+#ifndef LITETEST_BENCHMARK_H
+#define LITETEST_BENCHMARK_H
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include "core.h"
+
+namespace litetest {
+
+namespace internal {
+
+void use_char_pointer(const volatile char*);
+
+} // internal
+
+#if defined(__GNUC__) || defined(__clang__)
+
+/**
+ * Forces the compiler to assume 'value' is read, so that the computation
+ * producing it isn't optimized away from a benchmark.
+ */
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+/**
+ * Forces the compiler to assume all memory may have been read and written,
+ * so that pending writes of a benchmark aren't optimized away.
+ */
+inline void clobber_memory() {
+    asm volatile("" : : : "memory");
+}
+
+#else
+
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    internal::use_char_pointer(&reinterpret_cast<const volatile char&>(value));
+    _ReadWriteBarrier();
+}
+
+inline void clobber_memory() {
+    _ReadWriteBarrier();
+}
+
+#endif
+
+/**
+ * Defines a benchmark case.
+ * A benchmark case must be preceded by a declaration of a test suite.
+ * Its body is the code being measured: it is called repeatedly, with the
+ * number of iterations scaled until a sample reaches the target duration.
+ * Benchmarks are only executed by the 'bench' execution mode and are
+ * skipped by regular test runs.
+ * Use do_not_optimize() and clobber_memory() to prevent the compiler from
+ * discarding the measured code.
+ *
+ * Usage: BENCHMARK_CASE(your_benchmark_name) {
+ *      litetest::do_not_optimize(compute_something());
+ * }
+ */
+#define BENCHMARK_CASE(name) \
+    static void bench_##name(); \
+    static litetest::internal::CaseRegistration s_bench_##name( \
+        #name, bench_##name, __FILE__, __LINE__, litetest::internal::CaseKind::BENCHMARK); \
+    static void bench_##name()
+
+} // litetest
+
+#endif // LITETEST_BENCHMARK_H
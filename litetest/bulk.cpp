@@ -0,0 +1,334 @@
+#include "bulk.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LITETEST_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace litetest::internal {
+
+namespace {
+
+/**
+ * Elements checked per block. Blocks are checked without branching on
+ * individual elements; only a failing block is scanned element by element.
+ */
+constexpr size_t BLOCK_SIZE = 256;
+
+/**
+ * Scans blocks of [0, n) with 'block_fails', then the first failing block
+ * with 'fails' to locate the element. 'block_fails' may only report a block
+ * for which 'fails' holds for some element.
+ */
+template <typename BlockFails, typename Fails>
+size_t find_in_blocks(size_t n, const BlockFails& block_fails, const Fails& fails) {
+    for (size_t begin = 0; begin < n; begin += BLOCK_SIZE) {
+        size_t end = std::min(n, begin + BLOCK_SIZE);
+        if (!block_fails(begin, end)) {
+            continue;
+        }
+        for (size_t i = begin; i < end; ++i) {
+            if (fails(i)) {
+                return i;
+            }
+        }
+    }
+    return n;
+}
+
+template <typename T>
+bool is_near(T a, T b, T abs_tolerance, T rel_tolerance) {
+    // NaNs are never near anything, and infinities only near equal ones:
+    // their infinite difference would be within an infinite relative tolerance.
+    T difference = std::abs(a - b);
+    T tolerance = std::max(abs_tolerance, rel_tolerance * std::max(std::abs(a), std::abs(b)));
+    return a == b || (difference <= tolerance && difference < std::numeric_limits<T>::infinity());
+}
+
+/** Maps floating point values to integers ordered the same, consecutive values being adjacent. */
+int64_t ordered_bits(double value) {
+    int64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits < 0 ? std::numeric_limits<int64_t>::min() - bits : bits;
+}
+
+int64_t ordered_bits(float value) {
+    int32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits < 0 ? int64_t(std::numeric_limits<int32_t>::min()) - bits : bits;
+}
+
+template <typename T>
+bool is_within_ulps(T a, T b, uint64_t ulps) {
+    if (std::isnan(a) || std::isnan(b)) {
+        return false;
+    }
+    int64_t x = ordered_bits(a);
+    int64_t y = ordered_bits(b);
+    uint64_t distance = x > y ? uint64_t(x) - uint64_t(y) : uint64_t(y) - uint64_t(x);
+    return distance <= ulps;
+}
+
+template <typename T>
+bool is_out_of_range(T value, T min, T max) {
+    return !(min <= value && value <= max);
+}
+
+#ifdef LITETEST_HAS_SSE2
+
+// SSE2 is part of x86-64, so it needs no runtime detection. Each block
+// accumulates a mask of failing lanes, tested once per block.
+
+inline __m128d abs_pd(__m128d v) {
+    return _mm_andnot_pd(_mm_set1_pd(-0.0), v);
+}
+
+inline __m128 abs_ps(__m128 v) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+bool block_not_equal(const double* a, const double* b, size_t begin, size_t end) {
+    __m128d failing = _mm_setzero_pd();
+    size_t i = begin;
+    for (; i + 2 <= end; i += 2) {
+        failing = _mm_or_pd(failing, _mm_cmpneq_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    return _mm_movemask_pd(failing) != 0 || (i < end && !(a[i] == b[i]));
+}
+
+bool block_not_equal(const float* a, const float* b, size_t begin, size_t end) {
+    __m128 failing = _mm_setzero_ps();
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        failing = _mm_or_ps(failing, _mm_cmpneq_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    bool tail_fails = false;
+    for (; i < end; ++i) {
+        tail_fails |= !(a[i] == b[i]);
+    }
+    return _mm_movemask_ps(failing) != 0 || tail_fails;
+}
+
+bool block_not_near(const double* a, const double* b, size_t begin, size_t end,
+                    double abs_tolerance, double rel_tolerance) {
+    __m128d abs_tol = _mm_set1_pd(abs_tolerance);
+    __m128d rel_tol = _mm_set1_pd(rel_tolerance);
+    __m128d infinity = _mm_set1_pd(std::numeric_limits<double>::infinity());
+    __m128d failing = _mm_setzero_pd();
+    size_t i = begin;
+    for (; i + 2 <= end; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        __m128d y = _mm_loadu_pd(b + i);
+        __m128d tolerance = _mm_max_pd(abs_tol, _mm_mul_pd(rel_tol, _mm_max_pd(abs_pd(x), abs_pd(y))));
+        __m128d difference = abs_pd(_mm_sub_pd(x, y));
+        __m128d within = _mm_and_pd(_mm_cmple_pd(difference, tolerance), _mm_cmplt_pd(difference, infinity));
+        __m128d near = _mm_or_pd(_mm_cmpeq_pd(x, y), within);
+        failing = _mm_or_pd(failing, _mm_xor_pd(near, _mm_castsi128_pd(_mm_set1_epi32(-1))));
+    }
+    return _mm_movemask_pd(failing) != 0 ||
+           (i < end && !is_near(a[i], b[i], abs_tolerance, rel_tolerance));
+}
+
+bool block_not_near(const float* a, const float* b, size_t begin, size_t end,
+                    float abs_tolerance, float rel_tolerance) {
+    __m128 abs_tol = _mm_set1_ps(abs_tolerance);
+    __m128 rel_tol = _mm_set1_ps(rel_tolerance);
+    __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    __m128 failing = _mm_setzero_ps();
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(a + i);
+        __m128 y = _mm_loadu_ps(b + i);
+        __m128 tolerance = _mm_max_ps(abs_tol, _mm_mul_ps(rel_tol, _mm_max_ps(abs_ps(x), abs_ps(y))));
+        __m128 difference = abs_ps(_mm_sub_ps(x, y));
+        __m128 within = _mm_and_ps(_mm_cmple_ps(difference, tolerance), _mm_cmplt_ps(difference, infinity));
+        __m128 near = _mm_or_ps(_mm_cmpeq_ps(x, y), within);
+        failing = _mm_or_ps(failing, _mm_xor_ps(near, _mm_castsi128_ps(_mm_set1_epi32(-1))));
+    }
+    bool tail_fails = false;
+    for (; i < end; ++i) {
+        tail_fails |= !is_near(a[i], b[i], abs_tolerance, rel_tolerance);
+    }
+    return _mm_movemask_ps(failing) != 0 || tail_fails;
+}
+
+bool block_out_of_range(const double* a, size_t begin, size_t end, double min, double max) {
+    __m128d lo = _mm_set1_pd(min);
+    __m128d hi = _mm_set1_pd(max);
+    __m128d failing = _mm_setzero_pd();
+    size_t i = begin;
+    for (; i + 2 <= end; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        // Not-greater-or-equal comparisons are also true for NaNs.
+        failing = _mm_or_pd(failing, _mm_or_pd(_mm_cmpnge_pd(x, lo), _mm_cmpnle_pd(x, hi)));
+    }
+    return _mm_movemask_pd(failing) != 0 || (i < end && is_out_of_range(a[i], min, max));
+}
+
+bool block_out_of_range(const float* a, size_t begin, size_t end, float min, float max) {
+    __m128 lo = _mm_set1_ps(min);
+    __m128 hi = _mm_set1_ps(max);
+    __m128 failing = _mm_setzero_ps();
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(a + i);
+        failing = _mm_or_ps(failing, _mm_or_ps(_mm_cmpnge_ps(x, lo), _mm_cmpnle_ps(x, hi)));
+    }
+    bool tail_fails = false;
+    for (; i < end; ++i) {
+        tail_fails |= is_out_of_range(a[i], min, max);
+    }
+    return _mm_movemask_ps(failing) != 0 || tail_fails;
+}
+
+bool block_out_of_range(const int32_t* a, size_t begin, size_t end, int32_t min, int32_t max) {
+    __m128i lo = _mm_set1_epi32(min);
+    __m128i hi = _mm_set1_epi32(max);
+    __m128i failing = _mm_setzero_si128();
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        failing = _mm_or_si128(failing, _mm_or_si128(_mm_cmplt_epi32(x, lo), _mm_cmpgt_epi32(x, hi)));
+    }
+    bool tail_fails = false;
+    for (; i < end; ++i) {
+        tail_fails |= is_out_of_range(a[i], min, max);
+    }
+    return _mm_movemask_epi8(failing) != 0 || tail_fails;
+}
+
+#else
+
+// Portable blocks, which compilers may vectorize on their own.
+
+template <typename T>
+bool block_not_equal(const T* a, const T* b, size_t begin, size_t end) {
+    bool failing = false;
+    for (size_t i = begin; i < end; ++i) {
+        failing |= !(a[i] == b[i]);
+    }
+    return failing;
+}
+
+template <typename T>
+bool block_not_near(const T* a, const T* b, size_t begin, size_t end, T abs_tolerance, T rel_tolerance) {
+    bool failing = false;
+    for (size_t i = begin; i < end; ++i) {
+        failing |= !is_near(a[i], b[i], abs_tolerance, rel_tolerance);
+    }
+    return failing;
+}
+
+template <typename T>
+bool block_out_of_range(const T* a, size_t begin, size_t end, T min, T max) {
+    bool failing = false;
+    for (size_t i = begin; i < end; ++i) {
+        failing |= is_out_of_range(a[i], min, max);
+    }
+    return failing;
+}
+
+#endif // LITETEST_HAS_SSE2
+
+/** 64-bit integer comparisons are missing from SSE2, so ULPs are checked in plain blocks. */
+template <typename T>
+bool block_not_within_ulps(const T* a, const T* b, size_t begin, size_t end, uint64_t ulps) {
+    bool failing = false;
+    for (size_t i = begin; i < end; ++i) {
+        failing |= !is_within_ulps(a[i], b[i], ulps);
+    }
+    return failing;
+}
+
+template <typename T>
+size_t find_not_equal(const T* a, const T* b, size_t n) {
+    return find_in_blocks(n,
+        [&](size_t begin, size_t end) { return block_not_equal(a, b, begin, end); },
+        [&](size_t i) { return !(a[i] == b[i]); });
+}
+
+template <typename T>
+size_t find_not_near(const T* a, const T* b, size_t n, double abs_tolerance, double rel_tolerance) {
+    T abs_tol = T(abs_tolerance);
+    T rel_tol = T(rel_tolerance);
+    return find_in_blocks(n,
+        [&](size_t begin, size_t end) { return block_not_near(a, b, begin, end, abs_tol, rel_tol); },
+        [&](size_t i) { return !is_near(a[i], b[i], abs_tol, rel_tol); });
+}
+
+template <typename T>
+size_t find_not_within_ulps(const T* a, const T* b, size_t n, uint64_t ulps) {
+    return find_in_blocks(n,
+        [&](size_t begin, size_t end) { return block_not_within_ulps(a, b, begin, end, ulps); },
+        [&](size_t i) { return !is_within_ulps(a[i], b[i], ulps); });
+}
+
+template <typename T>
+size_t find_out_of_range(const T* a, size_t n, T min, T max) {
+    return find_in_blocks(n,
+        [&](size_t begin, size_t end) { return block_out_of_range(a, begin, end, min, max); },
+        [&](size_t i) { return is_out_of_range(a[i], min, max); });
+}
+
+} // namespace
+
+size_t first_difference(const void* a, const void* b, size_t n, size_t element_size) {
+    // memcmp() is vectorized by the C library. Compare in blocks to
+    // locate the first differing one, then its first differing element.
+    auto x = static_cast<const char*>(a);
+    auto y = static_cast<const char*>(b);
+    for (size_t begin = 0; begin < n; begin += BLOCK_SIZE) {
+        size_t count = std::min(n - begin, BLOCK_SIZE);
+        if (std::memcmp(x + begin * element_size, y + begin * element_size, count * element_size) == 0) {
+            continue;
+        }
+        for (size_t i = begin; i < begin + count; ++i) {
+            if (std::memcmp(x + i * element_size, y + i * element_size, element_size) != 0) {
+                return i;
+            }
+        }
+    }
+    return n;
+}
+
+size_t first_not_equal(const float* a, const float* b, size_t n) {
+    return find_not_equal(a, b, n);
+}
+
+size_t first_not_equal(const double* a, const double* b, size_t n) {
+    return find_not_equal(a, b, n);
+}
+
+size_t first_not_near(const float* a, const float* b, size_t n, double abs_tolerance, double rel_tolerance) {
+    return find_not_near(a, b, n, abs_tolerance, rel_tolerance);
+}
+
+size_t first_not_near(const double* a, const double* b, size_t n, double abs_tolerance, double rel_tolerance) {
+    return find_not_near(a, b, n, abs_tolerance, rel_tolerance);
+}
+
+size_t first_not_within_ulps(const float* a, const float* b, size_t n, uint64_t ulps) {
+    return find_not_within_ulps(a, b, n, ulps);
+}
+
+size_t first_not_within_ulps(const double* a, const double* b, size_t n, uint64_t ulps) {
+    return find_not_within_ulps(a, b, n, ulps);
+}
+
+size_t first_out_of_range(const float* a, size_t n, float min, float max) {
+    return find_out_of_range(a, n, min, max);
+}
+
+size_t first_out_of_range(const double* a, size_t n, double min, double max) {
+    return find_out_of_range(a, n, min, max);
+}
+
+size_t first_out_of_range(const int32_t* a, size_t n, int32_t min, int32_t max) {
+    return find_out_of_range(a, n, min, max);
+}
+
+} // litetest::internal
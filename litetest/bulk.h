@@ -0,0 +1,221 @@
+#ifndef LITETEST_BULK_H
+#define LITETEST_BULK_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+#include "internal.h"
+
+namespace litetest::internal {
+
+// Kernels locating the first element of a range failing a check, or 'n' if
+// all pass. They process data in blocks with SIMD instructions where
+// available, only looking at single elements within a failing block.
+
+/** First element whose bytes differ. */
+size_t first_difference(const void* a, const void* b, size_t n, size_t element_size);
+
+/** First element for which a[i] == b[i] doesn't hold. */
+size_t first_not_equal(const float* a, const float* b, size_t n);
+size_t first_not_equal(const double* a, const double* b, size_t n);
+
+/**
+ * First element farther from its expected value than both the absolute
+ * tolerance and the relative one, relative to the larger magnitude.
+ */
+size_t first_not_near(const float* a, const float* b, size_t n, double abs_tolerance, double rel_tolerance);
+size_t first_not_near(const double* a, const double* b, size_t n, double abs_tolerance, double rel_tolerance);
+
+/** First element more than 'ulps' representable values away from its expected value. */
+size_t first_not_within_ulps(const float* a, const float* b, size_t n, uint64_t ulps);
+size_t first_not_within_ulps(const double* a, const double* b, size_t n, uint64_t ulps);
+
+/** First element outside of [min, max]. NaNs are out of any range. */
+size_t first_out_of_range(const float* a, size_t n, float min, float max);
+size_t first_out_of_range(const double* a, size_t n, double min, double max);
+size_t first_out_of_range(const int32_t* a, size_t n, int32_t min, int32_t max);
+
+template <typename T>
+size_t first_not_equal(const T* a, const T* b, size_t n) {
+    if constexpr (std::is_integral_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>) {
+        // Equal values have equal bytes, which can be compared in bulk.
+        return first_difference(a, b, n, sizeof(T));
+    }
+    else {
+        for (size_t i = 0; i < n; ++i) {
+            if (!(a[i] == b[i])) {
+                return i;
+            }
+        }
+        return n;
+    }
+}
+
+template <typename T>
+size_t first_out_of_range(const T* a, size_t n, const T& min, const T& max) {
+    for (size_t i = 0; i < n; ++i) {
+        if (!(min <= a[i] && a[i] <= max)) {
+            return i;
+        }
+    }
+    return n;
+}
+
+/**
+ * Checks contiguous ranges of elements as a whole, see EXPECT_RANGE().
+ * Refers to the tested data rather than copying it, so it must not outlive
+ * the expression it was created in.
+ */
+template <typename T>
+class ExpectRange {
+public:
+    ExpectRange(const T* data, size_t size, int line)
+        : m_data(data), m_size(size), m_line(line) {}
+
+    /** Expects every element to equal the corresponding one of 'expected'. */
+    template <typename Range>
+    const ExpectRange& to_equal(const Range& expected) const {
+        return to_equal(std::data(expected), std::size(expected));
+    }
+
+    const ExpectRange& to_equal(const T* expected, size_t size) const {
+        t_assertions.count++;
+        check_size(size);
+        auto find = [&](size_t from) {
+            return from + first_not_equal(m_data + from, expected + from, m_size - from);
+        };
+        if (size_t i = find(0); i != m_size) {
+            fail_elementwise("Ranges differ", i, find, expected);
+        }
+        return *this;
+    }
+
+    /**
+     * Expects every element to be within 'abs_tolerance' of the corresponding
+     * one of 'expected', or within 'rel_tolerance' relative to the larger of
+     * their magnitudes. NaNs are never near anything, and infinities only
+     * near equal ones. For floating point elements.
+     */
+    template <typename Range>
+    const ExpectRange& to_be_near(const Range& expected, double abs_tolerance, double rel_tolerance = 0) const {
+        static_assert(std::is_floating_point_v<T>, "to_be_near() requires floating point elements.");
+        t_assertions.count++;
+        const T* other = std::data(expected);
+        check_size(std::size(expected));
+        auto find = [&](size_t from) {
+            return from + first_not_near(m_data + from, other + from, m_size - from, abs_tolerance, rel_tolerance);
+        };
+        if (size_t i = find(0); i != m_size) {
+            fail_elementwise("Ranges aren't near", i, find, other);
+        }
+        return *this;
+    }
+
+    /**
+     * Expects every element to be at most 'ulps' representable values away
+     * from the corresponding one of 'expected'. For floating point elements.
+     */
+    template <typename Range>
+    const ExpectRange& to_be_within_ulps(const Range& expected, uint64_t ulps) const {
+        static_assert(std::is_floating_point_v<T>, "to_be_within_ulps() requires floating point elements.");
+        t_assertions.count++;
+        const T* other = std::data(expected);
+        check_size(std::size(expected));
+        auto find = [&](size_t from) {
+            return from + first_not_within_ulps(m_data + from, other + from, m_size - from, ulps);
+        };
+        if (size_t i = find(0); i != m_size) {
+            fail_elementwise("Ranges differ by more than " + std::to_string(ulps) + " ULPs", i, find, other);
+        }
+        return *this;
+    }
+
+    /** Expects every element to be in [min, max]. */
+    const ExpectRange& to_be_in_range(const T& min, const T& max) const {
+        t_assertions.count++;
+        auto find = [&](size_t from) {
+            return from + first_out_of_range(m_data + from, m_size - from, min, max);
+        };
+        if (size_t i = find(0); i != m_size) {
+            fail_elementwise("Elements out of [" + stringify(min) + ", " + stringify(max) + "]",
+                             i, find, static_cast<const T*>(nullptr));
+        }
+        return *this;
+    }
+
+private:
+    /** Elements shown on each side of the first mismatch. */
+    static constexpr size_t CONTEXT = 3;
+
+    void check_size(size_t expected_size) const {
+        if (expected_size != m_size) {
+            fail_size(expected_size);
+        }
+    }
+
+    [[noreturn]] LITETEST_COLD void fail_size(size_t expected_size) const {
+        throw_failure("Expected " + std::to_string(expected_size) + " elements, got " + std::to_string(m_size), m_line);
+    }
+
+    /**
+     * Fails with the first mismatch at 'first', surrounded by a few elements,
+     * and the number of mismatches, counted by calling 'find' past each one.
+     */
+    template <typename Find>
+    [[noreturn]] LITETEST_COLD void fail_elementwise(const std::string& what, size_t first,
+                                                     const Find& find, const T* expected) const {
+        size_t n_mismatches = 0;
+        for (size_t i = first; i < m_size; i = find(i + 1)) {
+            n_mismatches++;
+        }
+
+        std::stringstream ss;
+        ss << what << " at index " << first << " (" << n_mismatches << " of " << m_size << " elements):";
+        size_t begin = first > CONTEXT ? first - CONTEXT : 0;
+        size_t end = std::min(m_size, first + CONTEXT + 1);
+        for (size_t i = begin; i < end; ++i) {
+            ss << "\n" << (i == first ? "  > [" : "    [") << i << "] " << stringify(m_data[i]);
+            if (expected) {
+                ss << " (expected " << stringify(expected[i]) << ")";
+            }
+        }
+        throw_failure(ss.str(), m_line);
+    }
+
+    const T* m_data;
+    size_t m_size;
+    int m_line;
+};
+
+template <typename Range>
+auto expect_range(int line, const Range& range) {
+    using T = std::remove_cv_t<std::remove_pointer_t<decltype(std::data(range))>>;
+    return ExpectRange<T>(std::data(range), std::size(range), line);
+}
+
+template <typename T>
+ExpectRange<T> expect_range(int line, const T* data, size_t size) {
+    return ExpectRange<T>(data, size, line);
+}
+
+} // litetest::internal
+
+/**
+ * Tests a contiguous range as a whole: either a container with std::data()
+ * and std::size(), or a pointer and a size. On failure, reports the first
+ * failing element with its neighbours and the number of failing elements.
+ *
+ * Usage examples:
+ *      EXPECT_RANGE(output).to_equal(expected);
+ *      EXPECT_RANGE(samples, n_samples).to_be_in_range(-1.0f, 1.0f);
+ *      EXPECT_RANGE(result).to_be_near(reference, 1e-9, 1e-6);
+ *      EXPECT_RANGE(result).to_be_within_ulps(reference, 4);
+ */
+#define EXPECT_RANGE(...) (::litetest::internal::expect_range(__LINE__, __VA_ARGS__))
+
+#endif // LITETEST_BULK_H
@@ -0,0 +1,186 @@
+#include "runner.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LITETEST_HAS_FD_CAPTURE 1
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace litetest::internal {
+
+#ifdef LITETEST_HAS_FD_CAPTURE
+
+namespace {
+
+int temp_fd(std::FILE*& file) {
+    file = std::tmpfile();
+    return file ? fileno(file) : -1;
+}
+
+void flush_streams() {
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    std::fflush(stderr);
+}
+
+/** Reads the whole file into 'out'. */
+void read_file(int fd, std::string& out) {
+    out.clear();
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        return;
+    }
+    out.resize(size_t(info.st_size));
+    size_t total = 0;
+    while (total < out.size()) {
+        ssize_t n = pread(fd, out.data() + total, out.size() - total, off_t(total));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        total += size_t(n);
+    }
+    out.resize(total);
+}
+
+} // namespace
+
+OutputCapture::OutputCapture() {
+    m_out_fd = temp_fd(m_out_file);
+    m_err_fd = temp_fd(m_err_file);
+    m_saved_out_fd = dup(STDOUT_FILENO);
+    m_saved_err_fd = dup(STDERR_FILENO);
+    m_enabled = m_out_fd >= 0 && m_err_fd >= 0 && m_saved_out_fd >= 0 && m_saved_err_fd >= 0;
+}
+
+OutputCapture::~OutputCapture() {
+    end();
+    if (m_out_file) {
+        std::fclose(m_out_file);
+    }
+    if (m_err_file) {
+        std::fclose(m_err_file);
+    }
+    if (m_saved_out_fd >= 0) {
+        close(m_saved_out_fd);
+    }
+    if (m_saved_err_fd >= 0) {
+        close(m_saved_err_fd);
+    }
+}
+
+void OutputCapture::begin() {
+    if (!m_enabled) {
+        return;
+    }
+    flush_streams();
+    // The redirected descriptors share the files' offsets, so rewind them too.
+    if (ftruncate(m_out_fd, 0) != 0 || ftruncate(m_err_fd, 0) != 0 ||
+        lseek(m_out_fd, 0, SEEK_SET) < 0 || lseek(m_err_fd, 0, SEEK_SET) < 0) {
+        return;
+    }
+    dup2(m_out_fd, STDOUT_FILENO);
+    dup2(m_err_fd, STDERR_FILENO);
+    m_capturing = true;
+}
+
+void OutputCapture::end() {
+    if (!m_capturing) {
+        return;
+    }
+    flush_streams();
+    dup2(m_saved_out_fd, STDOUT_FILENO);
+    dup2(m_saved_err_fd, STDERR_FILENO);
+    m_capturing = false;
+}
+
+void OutputCapture::read(std::string& out, std::string& err) const {
+    if (!m_enabled) {
+        out.clear();
+        err.clear();
+        return;
+    }
+    read_file(m_out_fd, out);
+    read_file(m_err_fd, err);
+}
+
+#else
+
+OutputCapture::OutputCapture() = default;
+
+OutputCapture::~OutputCapture() = default;
+
+void OutputCapture::begin() {}
+
+void OutputCapture::end() {}
+
+void OutputCapture::read(std::string& out, std::string& err) const {
+    out.clear();
+    err.clear();
+}
+
+#endif // LITETEST_HAS_FD_CAPTURE
+
+namespace {
+
+/** Output of the case the calling thread works for, if captured per case. */
+CapturedOutput* current_output() {
+    for (const ExecutionContext* context = t_context; context; context = context->parent) {
+        if (context->captured_output) {
+            return context->captured_output;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+StreamCapture::StreamCapture()
+    : m_out(std::cout.rdbuf(), false),
+      m_err(std::cerr.rdbuf(), true),
+      m_log(std::clog.rdbuf(), true) {
+    std::cout.flush();
+    std::cerr.flush();
+    std::clog.flush();
+    std::cout.rdbuf(&m_out);
+    std::cerr.rdbuf(&m_err);
+    std::clog.rdbuf(&m_log);
+}
+
+StreamCapture::~StreamCapture() {
+    std::cout.rdbuf(m_out.original());
+    std::cerr.rdbuf(m_err.original());
+    std::clog.rdbuf(m_log.original());
+}
+
+StreamCapture::RoutingBuffer::int_type StreamCapture::RoutingBuffer::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    char ch = traits_type::to_char_type(c);
+    return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+}
+
+std::streamsize StreamCapture::RoutingBuffer::xsputn(const char* s, std::streamsize n) {
+    // Without a put area, every write lands here, so threads don't share
+    // any state of the buffer itself.
+    if (CapturedOutput* output = current_output()) {
+        std::lock_guard lock(output->mutex);
+        (m_is_err ? output->err : output->out).append(s, size_t(n));
+        return n;
+    }
+    return m_original->sputn(s, n);
+}
+
+int StreamCapture::RoutingBuffer::sync() {
+    return current_output() ? 0 : m_original->pubsync();
+}
+
+} // litetest::internal
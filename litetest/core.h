@@ -0,0 +1,353 @@
+#ifndef LITETEST_CORE_H
+#define LITETEST_CORE_H
+
+// What test files need to declare suites and cases and make assertions,
+// kept to a few standard headers as it's compiled by every test file.
+// litetest.h, the usual include, adds what fixtures, helper threads and
+// running tests need; test files including core.h instead compile faster
+// still. Features such as PARAM_CASE() have headers of their own.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace litetest {
+
+/** Defined in stringify.h. */
+template <typename T>
+std::string stringify(const T& val);
+
+namespace internal {
+
+enum class CaseKind {
+    TEST,
+    BENCHMARK,
+    ASYNC
+};
+
+/**
+ * Coroutine of an asynchronous case, as seen by the runner. Coroutines only
+ * exist in C++20 code, so the runner handles them through these functions,
+ * provided by the TEST_CASE_ASYNC() macro.
+ */
+struct AsyncCoroutine {
+    void* frame = nullptr;
+    void (*resume)(void* frame) = nullptr;
+    bool (*done)(void* frame) = nullptr;
+
+    /** Rethrows what the coroutine threw, if anything. Only once done. */
+    void (*rethrow)(void* frame) = nullptr;
+
+    void (*destroy)(void* frame) = nullptr;
+};
+
+class CaseParams;
+
+// Registrations are made by the TEST_SUITE(), TEST_CASE(), SUITE_SETUP()...
+// macros during static initialization. They are statically allocated and
+// link themselves into intrusive lists, so registering never allocates.
+// process_suites() turns them into TestSuites and TestCases.
+
+struct CaseRegistration {
+    CaseRegistration(std::string_view name,
+                     void (*function)(),
+                     std::string_view src_file,
+                     int line,
+                     CaseKind kind = CaseKind::TEST,
+                     double timeout = 0,
+                     int stress_threads = 0,
+                     int64_t stress_iterations = 0);
+
+    /** Registers a parameterized case. */
+    CaseRegistration(std::string_view name,
+                     std::unique_ptr<CaseParams> (*make_params)(),
+                     std::string_view src_file,
+                     int line);
+
+    /** Registers an asynchronous case. */
+    CaseRegistration(std::string_view name,
+                     AsyncCoroutine (*start_async)(),
+                     std::string_view src_file,
+                     int line);
+
+    std::string_view name;
+    void (*function)();
+    std::unique_ptr<CaseParams> (*make_params)();
+    AsyncCoroutine (*start_async)();
+    std::string_view src_file;
+    int line;
+    CaseKind kind;
+    double timeout;
+    int stress_threads;
+    int64_t stress_iterations;
+    const CaseRegistration* next;
+};
+
+struct SuiteRegistration {
+    SuiteRegistration(std::string_view name, std::string_view src_file, int line);
+
+    std::string_view name;
+    std::string_view src_file;
+    int line;
+    const SuiteRegistration* next;
+};
+
+enum class SuiteHook {
+    SETUP,
+    CLEANUP
+};
+
+struct HookRegistration {
+    HookRegistration(std::string_view suite_name,
+                     std::string_view src_file,
+                     void (*function)(),
+                     SuiteHook hook);
+
+    std::string_view suite_name;
+    std::string_view src_file;
+    void (*function)();
+    SuiteHook hook;
+    const HookRegistration* next;
+};
+
+/**
+ * Number of assertions made by a thread. Counting per thread keeps assertions
+ * from contending on a shared counter. Counts are merged into a global total
+ * when their thread exits.
+ */
+struct AssertionCounter {
+    int64_t count = 0;
+    ~AssertionCounter();
+};
+
+inline thread_local AssertionCounter t_assertions;
+
+/**
+ * Throws a TestFailure for the current test case.
+ */
+[[noreturn]] void throw_failure(const std::string& message, int line);
+
+/** Throws a TestFailure for a value that isn't as expected. */
+[[noreturn]] void throw_comparison_failure(const char* expectation,
+                                           const std::string& expected,
+                                           const std::string& actual,
+                                           int line);
+
+/** Throws a TestFailure for a value that is, unexpectedly. */
+[[noreturn]] void throw_equality_failure(const std::string& value, int line);
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LITETEST_COLD __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+#define LITETEST_COLD __declspec(noinline)
+#else
+#define LITETEST_COLD
+#endif
+
+/**
+ * Refers to the value being tested by EXPECT() rather than copying it, so it
+ * must not outlive the expression it was created in. Failure messages are
+ * only formatted when an assertion fails.
+ */
+template<typename T>
+class ExpectValue {
+public:
+    const ExpectValue& to_be(const T& other) const {
+        t_assertions.count++;
+        if (m_val == other) {
+            return *this;
+        }
+        fail_comparison("Expected ", other);
+    }
+
+    const ExpectValue& to_not_be(const T& other) const {
+        t_assertions.count++;
+        if (m_val != other) {
+            return *this;
+        }
+        fail_equality();
+    }
+
+    const ExpectValue& to_be_greater_than(const T& other) const {
+        t_assertions.count++;
+        if (m_val > other) {
+            return *this;
+        }
+        fail_comparison("Expected value to be greater than ", other);
+    }
+
+    const ExpectValue& to_be_less_than(const T& other) const {
+        t_assertions.count++;
+        if (m_val < other) {
+            return *this;
+        }
+        fail_comparison("Expected value to be less than ", other);
+    }
+
+    const ExpectValue& to_be_greater_than_or_equal_to(const T& other) const {
+        t_assertions.count++;
+        if (m_val >= other) {
+            return *this;
+        }
+        fail_comparison("Expected value to be greater than or equal to ", other);
+    }
+
+    const ExpectValue& to_be_less_than_or_equal_to(const T& other) const {
+        t_assertions.count++;
+        if (m_val <= other) {
+            return *this;
+        }
+        fail_comparison("Expected value to be less than or equal to ", other);
+    }
+
+    ExpectValue(const T& val, int line)
+        : m_val(val), m_line(line) {}
+
+private:
+    [[noreturn]] LITETEST_COLD void fail_comparison(const char* expectation, const T& other) const;
+
+    [[noreturn]] LITETEST_COLD void fail_equality() const;
+
+    const T& m_val;
+    int m_line;
+};
+
+// Defined out of the class, so as not to be inline: explicit instantiation
+// declarations then keep test files from instantiating them.
+
+template <typename T>
+void ExpectValue<T>::fail_comparison(const char* expectation, const T& other) const {
+    throw_comparison_failure(expectation, stringify(other), stringify(m_val), m_line);
+}
+
+template <typename T>
+void ExpectValue<T>::fail_equality() const {
+    throw_equality_failure(stringify(m_val), m_line);
+}
+
+/**
+ * Types the library instantiates ExpectValue and stringify() for, so that
+ * test files only compile the fast paths inline and link to the failure
+ * paths. Test files testing other types must see stringify.h, which
+ * litetest.h includes.
+ */
+#define LITETEST_COMMON_TYPES(X) \
+    X(bool) X(char) X(int) X(unsigned) X(long) X(unsigned long) X(long long) X(unsigned long long) \
+    X(float) X(double) X(std::string) X(std::string_view) X(const char*)
+
+#define LITETEST_EXTERN_EXPECT_VALUE(T) extern template class ExpectValue<T>;
+LITETEST_COMMON_TYPES(LITETEST_EXTERN_EXPECT_VALUE)
+#undef LITETEST_EXTERN_EXPECT_VALUE
+
+} // internal
+
+#define LITETEST_EXTERN_STRINGIFY(T) extern template std::string stringify<T>(T const&);
+LITETEST_COMMON_TYPES(LITETEST_EXTERN_STRINGIFY)
+#undef LITETEST_EXTERN_STRINGIFY
+
+/**
+ * Defines a test suite.
+ * A test suite consists in a named group of test cases.
+ * Each test suite may contain a setup or a cleanup procedure, defined
+ * respectively by SUITE_SETUP() and SUITE_CLEANUP(). These procedures are
+ * guaranteed to be invoked before and after all test cases from the suite
+ * are executed.
+ *
+ * Usage: TEST_SUITE(your_suite_name);
+ */
+#define TEST_SUITE(name) \
+    static litetest::internal::SuiteRegistration s_suite##name(#name, __FILE__, __LINE__)
+
+/**
+ * Defines a test case.
+ * A test case must be preceded by a declaration of a test suite.
+ *
+ * Usage: TEST_CASE(your_case_name) {
+ *      // Your test case code here...
+ * }
+ */
+#define TEST_CASE(name) \
+    static void case_##name(); \
+    static litetest::internal::CaseRegistration s_case_##name(#name, case_##name, __FILE__, __LINE__); \
+    static void case_##name()
+
+/**
+ * Defines a test case that must complete within the given number of
+ * milliseconds, overriding RunTestsArgs::case_timeout for this case.
+ *
+ * Usage: TEST_CASE_TIMEOUT(your_case_name, 500) {
+ *      // Your test case code here...
+ * }
+ */
+#define TEST_CASE_TIMEOUT(name, timeout_ms) \
+    static void case_##name(); \
+    static litetest::internal::CaseRegistration s_case_##name( \
+        #name, case_##name, __FILE__, __LINE__, litetest::internal::CaseKind::TEST, (timeout_ms) / 1000.0); \
+    static void case_##name()
+
+/**
+ * Defines a test case that is always run in stress mode: from 'threads'
+ * threads at once, released together, 'iterations' times over. Failures
+ * of every thread are reported. See RunTestsArgs::stress_threads.
+ *
+ * Usage: TEST_CASE_STRESS(your_case_name, 8, 1000) {
+ *      queue.push(1);
+ *      EXPECT(queue.pop().has_value()).to_be(true);
+ * }
+ */
+#define TEST_CASE_STRESS(name, threads, iterations) \
+    static void case_##name(); \
+    static litetest::internal::CaseRegistration s_case_##name( \
+        #name, case_##name, __FILE__, __LINE__, litetest::internal::CaseKind::TEST, 0, threads, iterations); \
+    static void case_##name()
+
+/**
+ * Defines setup code for a test suite.
+ * The test suite setup code is guaranteed to be executed before
+ * the suite's test cases are run.
+ * Perform any initialization code required to run the tests here.
+ *
+ * Usage: SUITE_SETUP(your_suite_name) {
+ *      // Your setup code here...
+ * }
+ */
+#define SUITE_SETUP(suite_name) \
+    static void setup_##suite_name(); \
+    static litetest::internal::HookRegistration s_suite_setup_##suite_name( \
+        #suite_name, __FILE__, setup_##suite_name, litetest::internal::SuiteHook::SETUP); \
+    static void setup_##suite_name()
+
+/**
+ * Defines setup cleanup for a test suite.
+ * The test suite cleanup code is guaranteed to be executed after
+ * the suite's test cases are run.
+ * Perform any resource cleanup required to run after the
+ * suite's tests - independently of whether they fail, succeed or throw - here.
+ *
+ * Usage: SUITE_CLEANUP(your_suite_name) {
+ *      // Your setup code here...
+ * }
+ */
+#define SUITE_CLEANUP(suite_name) \
+    static void cleanup_##suite_name(); \
+    static litetest::internal::HookRegistration s_suite_cleanup_##suite_name( \
+        #suite_name, __FILE__, cleanup_##suite_name, litetest::internal::SuiteHook::CLEANUP); \
+    static void cleanup_##suite_name()
+
+/**
+ * Main macro for testing. Receives a value to be tested against other values
+ * or by itself. Fails the current test case by throwing TestFailure if the requested
+ * test fails.
+ *
+ * Usage examples:
+ *      EXPECT(foo()).to_be("some expected string");
+ *      EXPECT(sum(5,2)).to_be(7);
+ *      EXPECT(cost_of("something")).to_be_greater_than(200);
+ *
+ */
+#define EXPECT(value) (::litetest::internal::ExpectValue(value, __LINE__))
+
+} // litetest
+
+#endif // LITETEST_CORE_H
@@ -0,0 +1,33 @@
+#include "core.h"
+#include "stringify.h"
+
+namespace litetest {
+
+namespace internal {
+
+void throw_comparison_failure(const char* expectation,
+                              const std::string& expected,
+                              const std::string& actual,
+                              int line) {
+    std::string message = expectation;
+    message += expected;
+    message += ", got ";
+    message += actual;
+    throw_failure(message, line);
+}
+
+void throw_equality_failure(const std::string& value, int line) {
+    throw_failure("Expected " + value + " to be different", line);
+}
+
+#define LITETEST_INSTANTIATE_EXPECT_VALUE(T) template class ExpectValue<T>;
+LITETEST_COMMON_TYPES(LITETEST_INSTANTIATE_EXPECT_VALUE)
+#undef LITETEST_INSTANTIATE_EXPECT_VALUE
+
+} // internal
+
+#define LITETEST_INSTANTIATE_STRINGIFY(T) template std::string stringify<T>(T const&);
+LITETEST_COMMON_TYPES(LITETEST_INSTANTIATE_STRINGIFY)
+#undef LITETEST_INSTANTIATE_STRINGIFY
+
+} // litetest
@@ -0,0 +1,54 @@
+#include "internal.h"
+
+namespace litetest::internal {
+
+const void* SuiteFixtures::get(std::type_index type, std::thread::id worker, Factory make) {
+    Instance* instance;
+    {
+        std::lock_guard lock(m_mutex);
+        std::unique_ptr<Instance>& slot = m_instances[{ worker, type }];
+        if (!slot) {
+            slot = std::make_unique<Instance>();
+        }
+        instance = slot.get();
+    }
+
+    // Built outside of the lock, so that workers building their own
+    // instances of an expensive fixture don't wait for each other.
+    // A fixture that failed to build fails every case asking for it.
+    std::call_once(instance->built, [&]() {
+        try {
+            instance->object = make();
+        }
+        catch (...) {
+            instance->error = std::current_exception();
+            return;
+        }
+        std::lock_guard lock(m_mutex);
+        m_built.push_back(instance->object);
+    });
+    if (instance->error) {
+        std::rethrow_exception(instance->error);
+    }
+    return instance->object.get();
+}
+
+void SuiteFixtures::clear() {
+    std::lock_guard lock(m_mutex);
+    m_instances.clear();
+    while (!m_built.empty()) {
+        m_built.pop_back();
+    }
+}
+
+const void* suite_fixture(std::type_index type, SuiteFixtures::Factory make) {
+    // Helper threads of a case share its context, and so its fixtures.
+    for (const ExecutionContext* context = t_context; context; context = context->parent) {
+        if (context->test_case) {
+            return context->suite->fixtures->get(type, context->worker, make);
+        }
+    }
+    throw std::logic_error("Suite fixtures can only be used by test cases.");
+}
+
+} // litetest::internal
@@ -0,0 +1,60 @@
+#include "runner.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace litetest::internal {
+
+std::string case_history_key(const std::string& suite,
+                             const std::string& name,
+                             const std::string& src_file,
+                             int line) {
+    return src_file + ":" + std::to_string(line) + " " + suite + "." + name;
+}
+
+static std::optional<CaseStatus> parse_status(const std::string& name) {
+    for (CaseStatus status: { CaseStatus::PASSED, CaseStatus::FAILED, CaseStatus::INCOMPLETE,
+                              CaseStatus::CRASHED, CaseStatus::TIMED_OUT }) {
+        if (name == status_name(status)) {
+            return status;
+        }
+    }
+    return std::nullopt;
+}
+
+CaseHistory load_case_history(const std::string& path) {
+    CaseHistory history;
+    std::ifstream file(path);
+
+    // Each line reads '<status> <seconds> <key>'. Keys may contain spaces.
+    std::string status;
+    double seconds;
+    std::string key;
+    while (file >> status >> seconds && std::getline(file >> std::ws, key)) {
+        if (std::optional<CaseStatus> parsed = parse_status(status)) {
+            history[key] = { *parsed, seconds };
+        }
+    }
+    return history;
+}
+
+void save_case_history(const std::string& path, const CaseHistory& history) {
+    // Sorted so that the file diffs nicely between runs.
+    std::vector<std::pair<std::string, CaseHistoryEntry>> entries(history.begin(), history.end());
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    std::ofstream file(path);
+    for (const auto& [key, entry]: entries) {
+        file << status_name(entry.status) << ' ' << entry.seconds << ' ' << key << '\n';
+    }
+    file.flush();
+    if (!file) {
+        // The run's outcome stands, only reruns lose track of it.
+        std::cerr << "Warning: failed to write state file '" << path << "'." << std::endl;
+    }
+}
+
+} // litetest::internal
@@ -2,28 +2,122 @@
 #define LITETEST_INTERNAL_H
 
 #include <atomic>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <mutex>
 #include <vector>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <functional>
+#include <memory>
 #include <stdexcept>
 #include <optional>
 #include <thread>
+#include <typeindex>
+#include <utility>
 
+#include "core.h"
 #include "stringify.h"
 
+namespace litetest {
+struct RunTestsArgs;
+}
+
 namespace litetest::internal {
 
+struct CapturedOutput;
+
+/**
+ * An input of a parameterized case, as the instance of the case it makes.
+ */
+struct CaseInput {
+    /** Identifies the input in the name of its instance, e.g. its index. */
+    std::string label;
+
+    /** Runs the case on the input. */
+    std::function<void()> run;
+};
+
+/**
+ * Inputs of a parameterized case, each of them making an instance of the case.
+ */
+class CaseParams {
+public:
+    virtual ~CaseParams() = default;
+
+    /**
+     * Input 'i', or nothing past the last one. Inputs may be located as
+     * they're asked for, so only one thread at a time may call this, but
+     * the inputs' run() may be called from any thread.
+     */
+    virtual std::optional<CaseInput> input(size_t i) = 0;
+};
+
 struct TestCase {
     std::string name;
     std::function<void()> function;
     std::string src_file;
     int line;
+    CaseKind kind = CaseKind::TEST;
+
+    /** Time limit of the case in seconds, or 0 to use the run's. */
+    double timeout = 0;
+
+    /**
+     * Threads the case is run from at once, and how many times, in stress
+     * mode. 0 to use the run's settings.
+     */
+    int stress_threads = 0;
+    int64_t stress_iterations = 0;
+
+    /**
+     * Creates the inputs of a parameterized case, null for other cases.
+     * Parameterized cases aren't run themselves but through their instances,
+     * each created right before it runs, as inputs may be expensive to
+     * enumerate. The inputs are created the first time the case runs.
+     */
+    std::unique_ptr<CaseParams> (*make_params)() = nullptr;
+    std::shared_ptr<CaseParams> params;
+
+    /** The parameterized case this is an instance of, if any. */
+    const TestCase* instance_of = nullptr;
+
+    /** Creates the coroutine of an asynchronous case, suspended before its body. */
+    AsyncCoroutine (*start_async)() = nullptr;
 
     std::stringstream cout;
     std::stringstream cerr;
 };
 
+/**
+ * Fixtures of a suite, see litetest::suite_fixture(). Each worker running
+ * cases of the suite gets its own instances, built the first time one of
+ * its cases asks for them.
+ */
+class SuiteFixtures {
+public:
+    using Factory = std::shared_ptr<void> (*)();
+
+    /** The fixture of type 'type' of a worker, built with 'make' on first use. */
+    const void* get(std::type_index type, std::thread::id worker, Factory make);
+
+    /** Destroys every fixture, the last built first. */
+    void clear();
+
+private:
+    struct Instance {
+        std::once_flag built;
+        std::shared_ptr<void> object;
+        std::exception_ptr error;
+    };
+
+    std::mutex m_mutex;
+    std::map<std::pair<std::thread::id, std::type_index>, std::unique_ptr<Instance>> m_instances;
+    std::vector<std::shared_ptr<void>> m_built;
+};
+
 struct TestSuite {
     std::string name;
     std::string src_file;
@@ -31,6 +125,9 @@ struct TestSuite {
     std::function<void()> setup   = [](){};
     std::function<void()> cleanup = [](){};
     std::vector<TestCase*> cases;
+
+    /** Torn down along with the cleanup. */
+    std::unique_ptr<SuiteFixtures> fixtures = std::make_unique<SuiteFixtures>();
 };
 
 struct TestFailure : public std::runtime_error {
@@ -46,102 +143,156 @@ struct TestFailure : public std::runtime_error {
           test_case(test_case), test_suite(test_suite) {}
 };
 
-TestCase* push_case(const std::string&, std::function<void()>, const std::string&, int);
-
-TestSuite* push_suite(const std::string&, const std::string&, int);
+/**
+ * Registrations of the program, or of a test module: modules register into
+ * their own as they're loaded, see litetest::load_module().
+ */
+struct Registry {
+    const CaseRegistration* cases = nullptr;
+    const SuiteRegistration* suites = nullptr;
+    const HookRegistration* hooks = nullptr;
+};
 
-std::function<void()> push_suite_setup(const std::string&, const std::string&, std::function<void()>);
+/** Makes registrations go to 'registry'. Returns the one they went to. */
+Registry* set_registry(Registry* registry);
 
-std::function<void()> push_suite_cleanup(const std::string&, const std::string&, std::function<void()>);
+/** Registries of the loaded modules, in the order they were loaded. */
+std::vector<const Registry*> module_registries();
 
+/**
+ * The suites of the program, followed by those of each loaded module.
+ * Built on first use, then kept until discard_suites().
+ */
 std::vector<TestSuite*> process_suites();
 
-const TestCase& current_case(std::thread::id = std::this_thread::get_id());
+/**
+ * Destroys the suites and cases built by process_suites(), which rebuilds
+ * them on its next call. Must be called before unloading their code.
+ */
+void discard_suites();
+
+/**
+ * Blocks until the file of a loaded module changes, then until it's done
+ * changing, e.g. as a build rewrites it.
+ */
+void wait_for_module_changes();
+
+/**
+ * Set once a run must stop early. Checked between cases by the runners,
+ * and by test cases themselves through litetest::cancellation_requested().
+ */
+class CancellationToken {
+public:
+    void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+
+    bool cancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+private:
+    // Lock-free, so that it may be set from a signal handler.
+    std::atomic<bool> m_cancelled = false;
+};
+
+/**
+ * What a thread is currently executing on behalf of the runner.
+ * Contexts form a stack through their parent, and may be shared with
+ * helper threads spawned by a test case (see litetest::in_current_case()).
+ */
+struct ExecutionContext {
+    const TestSuite* suite = nullptr;
+    const TestCase* test_case = nullptr;
+    ExecutionContext* parent = nullptr;
+
+    /** Token of the run the case belongs to, if it can be cancelled. */
+    const CancellationToken* cancellation = nullptr;
+
+    /** Arguments of the run the case belongs to. */
+    const RunTestsArgs* args = nullptr;
+
+    /** Thread executing the case, which owns the suite fixtures it uses. */
+    std::thread::id worker;
+
+    /** First TestFailure thrown by a helper thread of the context. */
+    std::exception_ptr helper_failure;
+    std::mutex helper_mutex;
+
+    /** Assertions made by helper threads of the context. */
+    std::atomic<int64_t> helper_assertions = 0;
+
+    /** Checks skipped by the context's threads, e.g. of missing perf counters. */
+    std::atomic<int> skipped_checks = 0;
 
-const TestSuite& current_suite(std::thread::id = std::this_thread::get_id());
+    /** Where the context's threads' std::cout and std::cerr output goes, if captured per case. */
+    CapturedOutput* captured_output = nullptr;
 
-extern std::atomic_int g_assert_count;
+    void report_helper_failure(std::exception_ptr failure);
 
-template<typename T>
-class ExpectValue {
+    /** Rethrows the failure reported by a helper thread, if any. */
+    void rethrow_helper_failure();
+};
+
+inline thread_local ExecutionContext* t_context = nullptr;
+
+/**
+ * Makes a context current on the calling thread for the lifetime of the
+ * scope, restoring the previous one afterwards.
+ */
+class ContextScope {
 public:
-    const ExpectValue& to_be(const T& other) const {
-        g_assert_count++;
-        if (m_val == other) {
-            return *this;
-        }
-
-        std::stringstream ss;
-        ss << "Expected " << stringify(other) << ", got " << stringify(m_val);
-        throw TestFailure(ss.str(), current_case().name, current_suite().name, m_line);
-    }
-
-    const ExpectValue& to_not_be(const T& other) const {
-        g_assert_count++;
-        if (m_val != other) {
-            return *this;
-        }
-
-        std::stringstream ss;
-        ss << "Expected " << stringify(m_val) << " to be different";
-        throw TestFailure(ss.str(), current_case().name, current_suite().name, m_line);
-    }
-
-    const ExpectValue& to_be_greater_than(const T& other) const {
-        g_assert_count++;
-        if (m_val > other) {
-            return *this;
-        }
-
-        std::stringstream ss;
-        ss << "Expected value to be greater than " << stringify(other) << ", got " << stringify(m_val);
-        throw TestFailure(ss.str(), current_case().name, current_suite().name, m_line);
-    }
-
-    const ExpectValue& to_be_less_than(const T& other) const {
-        g_assert_count++;
-        if (m_val < other) {
-            return *this;
-        }
-
-        std::stringstream ss;
-        ss << "Expected value to be less than " << stringify(other) << ", got " << stringify(m_val);
-        throw TestFailure(ss.str(), current_case().name, current_suite().name, m_line);
-    }
-
-    const ExpectValue& to_be_greater_than_or_equal_to(const T& other) const {
-        g_assert_count++;
-        if (m_val >= other) {
-            return *this;
-        }
-
-        std::stringstream ss;
-        ss << "Expected value to be greater than or equal to " << stringify(other) << ", got " << stringify(m_val);
-        throw TestFailure(ss.str(), current_case().name, current_suite().name, m_line);
-    }
-
-    const ExpectValue& to_be_less_than_or_equal_to(const T& other) const {
-        g_assert_count++;
-        if (m_val <= other) {
-            return *this;
-        }
-
-        std::stringstream ss;
-        ss << "Expected value to be less than or equal to " << stringify(other) << ", got " << stringify(m_val);
-        throw TestFailure(ss.str(), current_case().name, current_suite().name, m_line);
-    }
-
-    ExpectValue(const T& val, int line)
-        : m_val(val), m_line(line) {}
-
-    ExpectValue(T&& val, int line)
-        : m_val(std::move(val)), m_line(line) {}
+    /** Pushes a new context for the given suite and case. */
+    ContextScope(const TestSuite* suite, const TestCase* test_case);
+
+    /** Makes an existing context, e.g. a parent thread's, current. */
+    explicit ContextScope(ExecutionContext* context);
+
+    ~ContextScope();
+
+    ContextScope(const ContextScope&) = delete;
+    ContextScope& operator=(const ContextScope&) = delete;
+
+    ExecutionContext& context() { return *t_context; }
 
 private:
-    T m_val;
-    int m_line;
+    std::optional<ExecutionContext> m_owned;
+    ExecutionContext* m_previous;
+};
+
+const TestCase& current_case();
+
+/**
+ * The suite fixture of type 'type' of the worker running the current case.
+ * Throws std::logic_error outside of test cases.
+ */
+const void* suite_fixture(std::type_index type, SuiteFixtures::Factory make);
+
+const TestSuite& current_suite();
+
+/**
+ * Total number of assertions made so far by exited threads and the calling one.
+ */
+int64_t assertion_count();
+
+/**
+ * Adds assertions made elsewhere (e.g. by a worker process) to the global total.
+ */
+void add_assertions(int64_t count);
+
+/**
+ * Heap allocations made through operator new by a thread, counted by the
+ * global allocation functions of the litetest_allocs library. Only
+ * differences between two readings are meaningful.
+ */
+struct AllocationCounters {
+    int64_t count;
+    int64_t bytes;
+    int64_t live_bytes;
+    int64_t peak_live_bytes;
 };
 
+extern thread_local AllocationCounters t_allocations;
+
+/** True if the program links litetest_allocs, i.e. allocations are counted. */
+extern bool g_allocation_hooks;
+
 }
 
 #endif // LITETEST_INTERNAL_H
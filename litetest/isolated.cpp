@@ -0,0 +1,756 @@
+#include "runner.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LITETEST_HAS_FORK 1
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+namespace litetest::internal {
+
+#ifdef LITETEST_HAS_FORK
+
+namespace {
+
+/** Messages sent from a worker process to the parent. */
+enum class MessageType : int32_t {
+    /** The worker finished the suite's setup, taking 'time'. */
+    SETUP_END,
+    /**
+     * The worker is about to run the case at 'case_index', or its instance
+     * 'instance' if parameterized, 'message' holding the instance's label.
+     */
+    CASE_BEGIN,
+    /**
+     * The case at 'case_index', or its instance 'instance', finished with
+     * the given status. A parameterized case whose inputs couldn't be
+     * created finishes without instances.
+     */
+    CASE_END,
+    /** The worker finished the suite, its cleanup taking 'time'. */
+    SUITE_END,
+    /** The suite could not be run. 'message' holds the error. */
+    FATAL
+};
+
+struct MessageHeader {
+    MessageType type;
+    int32_t case_index;
+    /** Index of the input of a parameterized case, -1 for other cases. */
+    int32_t instance;
+    CaseStatus status;
+    int32_t line;
+    int32_t n_assertions;
+    int32_t n_checks_skipped;
+    Timing time;
+    uint32_t message_size;
+    /** Sizes of the captured output following the message, if any. */
+    uint32_t stdout_size;
+    uint32_t stderr_size;
+    /** Heap allocations of the case, if tracked. */
+    bool has_allocations;
+    AllocationStats allocations;
+    /** Measurements of the case, if it ran in stress mode. */
+    bool has_stress;
+    StressStats stress;
+};
+
+/**
+ * Work item handed to a worker: run a suite starting at a given case, and
+ * at a given instance of that case if it's parameterized.
+ */
+struct SuiteJob {
+    int32_t suite_index;
+    int32_t first_case;
+    int32_t first_instance;
+};
+
+bool write_all(int fd, const void* data, size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, bytes, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+bool read_all(int fd, void* data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::read(fd, bytes, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+void send_message(int fd,
+                  MessageType type,
+                  int case_index = -1,
+                  int instance = -1,
+                  CaseStatus status = CaseStatus::PASSED,
+                  int line = 0,
+                  int n_assertions = 0,
+                  Timing time = {},
+                  const std::string& message = "",
+                  const std::string& captured_stdout = "",
+                  const std::string& captured_stderr = "",
+                  const std::optional<AllocationStats>& allocations = std::nullopt,
+                  const std::optional<StressStats>& stress = std::nullopt,
+                  int n_checks_skipped = 0) {
+    MessageHeader header { type, case_index, instance, status, line, n_assertions, n_checks_skipped, time,
+                           uint32_t(message.size()),
+                           uint32_t(captured_stdout.size()),
+                           uint32_t(captured_stderr.size()),
+                           allocations.has_value(),
+                           allocations.value_or(AllocationStats()),
+                           stress.has_value(),
+                           stress.value_or(StressStats()) };
+    if (!write_all(fd, &header, sizeof(header)) ||
+        !write_all(fd, message.data(), message.size()) ||
+        !write_all(fd, captured_stdout.data(), captured_stdout.size()) ||
+        !write_all(fd, captured_stderr.data(), captured_stderr.size())) {
+        // The parent is gone, nobody is listening anymore.
+        std::_Exit(EXIT_FAILURE);
+    }
+}
+
+/** Cancellation token of the worker process, set by SIGUSR1. */
+CancellationToken s_worker_cancellation;
+
+void handle_cancel_signal(int) {
+    s_worker_cancellation.cancel();
+}
+
+/**
+ * Body of a worker process. Receives jobs through job_fd until it is closed
+ * and streams the results of each one back through result_fd.
+ */
+[[noreturn]] void worker_main(const std::vector<SuiteRun>& runs,
+                              const RunTestsArgs& args,
+                              OutputCapture* capture,
+                              int job_fd,
+                              int result_fd) {
+    // Workers may be killed at any time, e.g. by a timeout. Line buffering
+    // keeps what was printed until then from being lost with them.
+    std::setvbuf(stdout, nullptr, _IOLBF, BUFSIZ);
+
+    // SIGUSR1 was blocked by the parent until the handler is in place.
+    struct sigaction cancel_action {};
+    cancel_action.sa_handler = handle_cancel_signal;
+    cancel_action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &cancel_action, nullptr);
+    sigset_t cancel_set;
+    sigemptyset(&cancel_set);
+    sigaddset(&cancel_set, SIGUSR1);
+    pthread_sigmask(SIG_UNBLOCK, &cancel_set, nullptr);
+
+    SuiteJob job {};
+    while (read_all(job_fd, &job, sizeof(job))) {
+        const SuiteRun& run = runs[job.suite_index];
+        TestSuite* suite = run.suite;
+        try {
+            Stopwatch setup_stopwatch;
+            ContextScope setup_scope(suite, nullptr);
+            suite->setup();
+            send_message(result_fd, MessageType::SETUP_END, -1, -1, CaseStatus::PASSED, 0, 0,
+                         setup_stopwatch.elapsed());
+
+            auto send_result = [result_fd](int case_index, int instance, const CaseResult& result) {
+                send_message(result_fd, MessageType::CASE_END, case_index, instance,
+                             result.status, result.line,
+                             result.n_assertions, result.time,
+                             result.message,
+                             result.captured_stdout,
+                             result.captured_stderr,
+                             result.allocations,
+                             result.stress,
+                             result.n_checks_skipped);
+            };
+
+            for (size_t i = job.first_case; i < run.cases.size(); ++i) {
+                if (s_worker_cancellation.cancelled()) {
+                    break;
+                }
+                TestCase* test_case = run.cases[i];
+
+                if (test_case->make_params) {
+                    size_t first = i == size_t(job.first_case) ? size_t(job.first_instance) : 0;
+                    InstanceCursor cursor(test_case, run.select_instance, first);
+                    while (!s_worker_cancellation.cancelled()) {
+                        std::unique_ptr<TestCase> instance;
+                        size_t index = 0;
+                        try {
+                            instance = cursor.next(&index);
+                        }
+                        catch (const std::exception& e) {
+                            send_result(int(i), -1, inputs_failure(suite, test_case, e));
+                            break;
+                        }
+                        if (!instance) {
+                            break;
+                        }
+                        std::string label = instance->name.substr(test_case->name.size() + 1);
+                        label.pop_back();
+                        send_message(result_fd, MessageType::CASE_BEGIN, int(i), int(index),
+                                     CaseStatus::PASSED, 0, 0, {}, label);
+                        CaseResult result = execute_case(suite, instance.get(), args, capture,
+                                                         &s_worker_cancellation);
+                        std::cout.flush();
+                        std::cerr.flush();
+                        send_result(int(i), int(index), result);
+                    }
+                    continue;
+                }
+
+                send_message(result_fd, MessageType::CASE_BEGIN, int(i));
+                CaseResult result;
+                if (test_case->kind == CaseKind::ASYNC) {
+                    // Run alone, so that a crash is attributed to the right case.
+                    execute_async_cases(suite, { test_case }, args, &s_worker_cancellation,
+                                        [&result](const CaseResult& finished) { result = finished; });
+                }
+                else {
+                    result = execute_case(suite, test_case, args, capture, &s_worker_cancellation);
+                }
+                std::cout.flush();
+                std::cerr.flush();
+                send_result(int(i), -1, result);
+            }
+
+            Stopwatch cleanup_stopwatch;
+            {
+                ContextScope cleanup_scope(suite, nullptr);
+                FixtureTeardown teardown(suite);
+                suite->cleanup();
+            }
+            send_message(result_fd, MessageType::SUITE_END, -1, -1, CaseStatus::PASSED, 0, 0,
+                         cleanup_stopwatch.elapsed());
+        }
+        catch (const std::exception& e) {
+            send_message(result_fd, MessageType::FATAL, -1, -1, CaseStatus::PASSED, 0, 0, {}, e.what());
+        }
+        catch (...) {
+            send_message(result_fd, MessageType::FATAL, -1, -1, CaseStatus::PASSED, 0, 0, {},
+                         "Suite '" + suite->name + "' threw an unknown exception.");
+        }
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    std::_Exit(EXIT_SUCCESS);
+}
+
+std::string describe_exit_status(int status) {
+    if (WIFSIGNALED(status)) {
+        int sig = WTERMSIG(status);
+        const char* sig_name = strsignal(sig);
+        return "Terminated by signal " + std::to_string(sig) +
+               (sig_name ? std::string(" (") + sig_name + ")" : std::string()) + ".";
+    }
+    if (WIFEXITED(status)) {
+        return "Exited with status " + std::to_string(WEXITSTATUS(status)) + ".";
+    }
+    return "Terminated abnormally.";
+}
+
+/**
+ * Parent-side handle of a worker process.
+ */
+struct Worker {
+    pid_t pid = -1;
+    int job_fd = -1;
+    int result_fd = -1;
+
+    /** Job currently assigned to the worker, if busy. */
+    bool busy = false;
+    SuiteJob job {};
+
+    /** Case currently being run by the worker, or -1 if outside of a case. */
+    int running_case = -1;
+    Clock::time_point case_start;
+
+    /** Instance of the running case, and its index, if parameterized. */
+    std::unique_ptr<TestCase> instance;
+    int running_instance = -1;
+
+    /**
+     * Created before forking, so that the parent can still read the
+     * output of a case that crashed the worker. Null if not capturing.
+     */
+    std::unique_ptr<OutputCapture> capture;
+};
+
+void close_worker_pipes(Worker& worker) {
+    close(worker.job_fd);
+    close(worker.result_fd);
+    worker.job_fd = -1;
+    worker.result_fd = -1;
+}
+
+/**
+ * Forks a new worker. The pipes of the already existing workers are closed
+ * on the child, otherwise they would never see their job pipe hit EOF.
+ */
+Worker spawn_worker(const std::vector<SuiteRun>& runs,
+                    const RunTestsArgs& args,
+                    const std::vector<Worker>& workers) {
+    int job_pipe[2];
+    int result_pipe[2];
+    if (pipe(job_pipe) != 0) {
+        throw std::runtime_error(std::string("Failed to create worker pipe: ") + std::strerror(errno));
+    }
+    if (pipe(result_pipe) != 0) {
+        close(job_pipe[0]);
+        close(job_pipe[1]);
+        throw std::runtime_error(std::string("Failed to create worker pipe: ") + std::strerror(errno));
+    }
+
+    std::unique_ptr<OutputCapture> capture;
+    if (args.capture_output) {
+        capture = std::make_unique<OutputCapture>();
+    }
+
+    // Anything still buffered would otherwise be printed by both processes.
+    std::cout.flush();
+    std::cerr.flush();
+
+    // Keeps a cancellation from killing the child before it can handle it.
+    sigset_t cancel_set;
+    sigset_t old_mask;
+    sigemptyset(&cancel_set);
+    sigaddset(&cancel_set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &cancel_set, &old_mask);
+
+    pid_t pid = fork();
+    if (pid != 0) {
+        pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+    }
+    if (pid < 0) {
+        for (int fd: { job_pipe[0], job_pipe[1], result_pipe[0], result_pipe[1] }) {
+            close(fd);
+        }
+        throw std::runtime_error(std::string("Failed to fork worker: ") + std::strerror(errno));
+    }
+
+    if (pid == 0) {
+        for (const Worker& other: workers) {
+            if (other.pid > 0) {
+                close(other.job_fd);
+                close(other.result_fd);
+            }
+        }
+        close(job_pipe[1]);
+        close(result_pipe[0]);
+        worker_main(runs, args, capture.get(), job_pipe[0], result_pipe[1]);
+    }
+
+    close(job_pipe[0]);
+    close(result_pipe[1]);
+
+    Worker worker;
+    worker.pid = pid;
+    worker.job_fd = job_pipe[1];
+    worker.result_fd = result_pipe[0];
+    worker.capture = std::move(capture);
+    return worker;
+}
+
+/** Closes the worker's pipes and waits for it to exit. Returns its exit status. */
+int shutdown_worker(Worker& worker) {
+    close_worker_pipes(worker);
+    int status = 0;
+    while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {}
+    worker.pid = -1;
+    return status;
+}
+
+void assign_job(Worker& worker, const SuiteJob& job) {
+    worker.busy = true;
+    worker.job = job;
+    worker.running_case = -1;
+    worker.running_instance = -1;
+    // If the worker died in the meantime, the write fails and its
+    // closed result pipe is handled as a crash by the caller.
+    write_all(worker.job_fd, &job, sizeof(job));
+}
+
+/**
+ * Records the outcome of a job its worker didn't complete, either because
+ * it crashed or because it was killed for running out of time. 'status' and
+ * 'reason' describe what happened to the case in progress. Returns the job
+ * that must be scheduled to resume the suite, if any and if 'resume' is set.
+ */
+std::optional<SuiteJob> abandon_job(RunState& state,
+                                    const std::vector<SuiteRun>& runs,
+                                    Worker& worker,
+                                    CaseStatus status,
+                                    const std::string& reason,
+                                    bool resume) {
+    const SuiteRun& run = runs[worker.job.suite_index];
+    TestSuite* suite = run.suite;
+    const char* what = status == CaseStatus::CRASHED ? "crashed" : "timed out";
+
+    // Cases of the suite that won't be run, with what to report for them.
+    size_t first_skipped = run.cases.size();
+    std::string skipped_reason;
+
+    if (worker.running_case < 0) {
+        // Outside of a case, i.e. in setup or cleanup. If it was the setup,
+        // there's no point in retrying the same suite, so its pending cases
+        // share its fate.
+        std::cerr << "Suite '" << suite->name << "' " << what << " outside of a test case:\n" << reason << std::endl;
+        // A parameterized case some instances of which ran isn't pending anymore.
+        first_skipped = size_t(worker.job.first_case) + (worker.job.first_instance > 0 ? 1 : 0);
+        skipped_reason = std::string("Suite setup ") + what + ". " + reason;
+    }
+    else {
+        CaseResult result;
+        result.suite = suite;
+        result.test_case = worker.running_instance >= 0 ? worker.instance.get() : run.cases[worker.running_case];
+        result.status = status;
+        result.message = reason;
+        // CPU time of the lost process is lost with it.
+        result.time.wall_seconds = seconds_since(worker.case_start);
+        if (worker.capture) {
+            worker.capture->read(result.captured_stdout, result.captured_stderr);
+        }
+        state.record(result);
+
+        size_t next_case = size_t(worker.running_case) + 1;
+        if (resume && worker.running_instance >= 0) {
+            return SuiteJob { worker.job.suite_index, int32_t(worker.running_case), worker.running_instance + 1 };
+        }
+        if (resume && next_case < run.cases.size()) {
+            return SuiteJob { worker.job.suite_index, int32_t(next_case), 0 };
+        }
+        if (!resume) {
+            first_skipped = next_case;
+            skipped_reason = "Not run. " + reason;
+        }
+    }
+
+    for (size_t i = first_skipped; i < run.cases.size(); ++i) {
+        CaseResult result;
+        result.suite = suite;
+        result.test_case = run.cases[i];
+        result.status = status;
+        result.message = skipped_reason;
+        state.record(result);
+    }
+    return std::nullopt;
+}
+
+/**
+ * Called when a worker's result pipe is closed while it still had a job.
+ * Reports the interrupted case as crashed and returns the job that
+ * must be scheduled to resume the suite, if any.
+ */
+std::optional<SuiteJob> handle_crash(RunState& state,
+                                     const std::vector<SuiteRun>& runs,
+                                     Worker& worker) {
+    int status = shutdown_worker(worker);
+    return abandon_job(state, runs, worker, CaseStatus::CRASHED, describe_exit_status(status), true);
+}
+
+/**
+ * Kills a worker whose case or suite ran past its deadline. The suite is
+ * resumed at the next case if only the case was out of time.
+ */
+std::optional<SuiteJob> handle_timeout(RunState& state,
+                                       const std::vector<SuiteRun>& runs,
+                                       Worker& worker,
+                                       bool suite_expired,
+                                       double limit_seconds) {
+    kill(worker.pid, SIGKILL);
+    shutdown_worker(worker);
+
+    const SuiteRun& run = runs[worker.job.suite_index];
+    std::string reason = suite_expired
+        ? "Suite '" + run.suite->name + "' exceeded its time limit of " + format_ms(limit_seconds) + "."
+        : "Timed out after " + format_ms(seconds_since(worker.case_start)) +
+          " (limit of " + format_ms(limit_seconds) + ").";
+    return abandon_job(state, runs, worker, CaseStatus::TIMED_OUT, reason, !suite_expired);
+}
+
+struct Deadline {
+    Clock::time_point at;
+    double limit_seconds;
+    /** True if it's the suite's deadline rather than the running case's. */
+    bool suite;
+};
+
+/** Earliest deadline of what a busy worker is running, if it has any. */
+std::optional<Deadline> worker_deadline(const Worker& worker,
+                                        const std::vector<SuiteRun>& runs,
+                                        const RunTestsArgs& args,
+                                        const std::vector<Clock::time_point>& suite_starts) {
+    auto after = [](Clock::time_point start, double seconds) {
+        return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    };
+
+    std::optional<Deadline> deadline;
+    if (args.suite_timeout > 0) {
+        deadline = Deadline { after(suite_starts[worker.job.suite_index], args.suite_timeout),
+                              args.suite_timeout, true };
+    }
+    if (worker.running_case >= 0) {
+        const TestCase& test_case = *runs[worker.job.suite_index].cases[worker.running_case];
+        double limit = case_time_limit(test_case, args);
+        if (limit > 0 && (!deadline || after(worker.case_start, limit) < deadline->at)) {
+            deadline = Deadline { after(worker.case_start, limit), limit, false };
+        }
+    }
+    return deadline;
+}
+
+} // namespace
+
+void run_suites_isolated(RunState& state,
+                         const std::vector<SuiteRun>& runs,
+                         const RunTestsArgs& args) {
+    std::deque<SuiteJob> pending;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        pending.push_back({ int32_t(i), 0, 0 });
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    // Writing to the pipe of a worker that just died must not kill us.
+    struct sigaction ignore_pipe {};
+    struct sigaction old_pipe {};
+    ignore_pipe.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore_pipe, &old_pipe);
+
+    size_t n_workers = std::max(1, std::min(args.jobs, int(runs.size())));
+    std::vector<Worker> workers;
+    try {
+        for (size_t i = 0; i < n_workers; ++i) {
+            workers.push_back(spawn_worker(runs, args, workers));
+        }
+
+        // Suites keep their start time when resumed after a crash.
+        std::vector<Clock::time_point> suite_starts(runs.size());
+
+        size_t n_busy = 0;
+        bool cancel_sent = false;
+        while (!pending.empty() || n_busy > 0) {
+            for (Worker& worker: workers) {
+                if (!worker.busy && !pending.empty()) {
+                    if (pending.front().first_case == 0 && pending.front().first_instance == 0) {
+                        suite_starts[pending.front().suite_index] = Clock::now();
+                    }
+                    assign_job(worker, pending.front());
+                    pending.pop_front();
+                    n_busy++;
+                }
+            }
+
+            // Wake up in time for the nearest deadline.
+            int timeout_ms = -1;
+            Clock::time_point now = Clock::now();
+            for (const Worker& worker: workers) {
+                std::optional<Deadline> deadline;
+                if (worker.busy && (deadline = worker_deadline(worker, runs, args, suite_starts))) {
+                    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline->at - now).count();
+                    int ms = int(std::max<decltype(remaining)>(remaining, 0));
+                    timeout_ms = timeout_ms < 0 ? ms : std::min(timeout_ms, ms);
+                }
+            }
+
+            std::vector<pollfd> fds;
+            for (const Worker& worker: workers) {
+                fds.push_back({ worker.result_fd, POLLIN, 0 });
+            }
+            if (poll(fds.data(), fds.size(), timeout_ms) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Failed to poll workers: ") + std::strerror(errno));
+            }
+
+            for (size_t i = 0; i < workers.size(); ++i) {
+                if (fds[i].revents == 0) {
+                    continue;
+                }
+                Worker& worker = workers[i];
+                const SuiteRun& run = runs[worker.job.suite_index];
+                TestSuite* suite = run.suite;
+
+                MessageHeader header {};
+                std::string message;
+                std::string captured_stdout;
+                std::string captured_stderr;
+                bool ok = read_all(worker.result_fd, &header, sizeof(header));
+                if (ok) {
+                    message.resize(header.message_size);
+                    captured_stdout.resize(header.stdout_size);
+                    captured_stderr.resize(header.stderr_size);
+                    ok = read_all(worker.result_fd, message.data(), message.size()) &&
+                         read_all(worker.result_fd, captured_stdout.data(), captured_stdout.size()) &&
+                         read_all(worker.result_fd, captured_stderr.data(), captured_stderr.size());
+                }
+
+                if (!ok) {
+                    if (worker.busy) {
+                        std::optional<SuiteJob> resume = handle_crash(state, runs, worker);
+                        if (resume) {
+                            pending.push_front(*resume);
+                        }
+                        n_busy--;
+                    }
+                    else {
+                        shutdown_worker(worker);
+                    }
+                    worker = spawn_worker(runs, args, workers);
+                    continue;
+                }
+
+                switch (header.type) {
+                    case MessageType::SETUP_END:
+                        state.record_setup(suite, header.time);
+                        break;
+                    case MessageType::CASE_BEGIN:
+                        worker.running_case = header.case_index;
+                        worker.running_instance = header.instance;
+                        if (header.instance >= 0) {
+                            worker.instance = make_instance(*run.cases[header.case_index], message, nullptr);
+                        }
+                        worker.case_start = Clock::now();
+                        break;
+                    case MessageType::CASE_END: {
+                        CaseResult result;
+                        result.suite = suite;
+                        result.test_case = header.instance >= 0 ? worker.instance.get() : run.cases[header.case_index];
+                        result.status = header.status;
+                        result.line = header.line;
+                        result.message = std::move(message);
+                        result.captured_stdout = std::move(captured_stdout);
+                        result.captured_stderr = std::move(captured_stderr);
+                        result.time = header.time;
+                        result.n_assertions = header.n_assertions;
+                        result.n_checks_skipped = header.n_checks_skipped;
+                        if (header.has_allocations) {
+                            result.allocations = header.allocations;
+                        }
+                        if (header.has_stress) {
+                            result.stress = header.stress;
+                        }
+                        add_assertions(header.n_assertions);
+                        state.record(result);
+
+                        // Past the last case, a crash can only come from the cleanup.
+                        worker.running_case = -1;
+                        worker.running_instance = -1;
+                        if (header.instance >= 0) {
+                            worker.job.first_case = header.case_index;
+                            worker.job.first_instance = header.instance + 1;
+                        }
+                        else {
+                            worker.job.first_case = header.case_index + 1;
+                            worker.job.first_instance = 0;
+                        }
+                        break;
+                    }
+                    case MessageType::SUITE_END:
+                        state.record_cleanup(suite, header.time);
+                        worker.busy = false;
+                        n_busy--;
+                        break;
+                    case MessageType::FATAL:
+                        state.set_fatal_error(std::make_exception_ptr(std::runtime_error(message)));
+                        worker.busy = false;
+                        n_busy--;
+                        break;
+                }
+            }
+
+            // Replace workers stuck past their deadline.
+            for (Worker& worker: workers) {
+                if (!worker.busy) {
+                    continue;
+                }
+                std::optional<Deadline> deadline = worker_deadline(worker, runs, args, suite_starts);
+                if (!deadline || Clock::now() < deadline->at) {
+                    continue;
+                }
+                std::optional<SuiteJob> resume = handle_timeout(state, runs, worker,
+                                                                deadline->suite, deadline->limit_seconds);
+                if (resume) {
+                    pending.push_front(*resume);
+                }
+                n_busy--;
+                worker = spawn_worker(runs, args, workers);
+            }
+
+            // Once cancelled, drop what's queued and have busy workers skip
+            // to their suite's cleanup.
+            if (state.cancelled()) {
+                pending.clear();
+                if (!cancel_sent) {
+                    for (const Worker& worker: workers) {
+                        if (worker.busy) {
+                            kill(worker.pid, SIGUSR1);
+                        }
+                    }
+                    cancel_sent = true;
+                }
+            }
+        }
+    }
+    catch (...) {
+        for (Worker& worker: workers) {
+            if (worker.pid > 0) {
+                kill(worker.pid, SIGKILL);
+                shutdown_worker(worker);
+            }
+        }
+        sigaction(SIGPIPE, &old_pipe, nullptr);
+        throw;
+    }
+
+    for (Worker& worker: workers) {
+        shutdown_worker(worker);
+    }
+    sigaction(SIGPIPE, &old_pipe, nullptr);
+}
+
+#else
+
+void run_suites_isolated(RunState&,
+                         const std::vector<SuiteRun>&,
+                         const RunTestsArgs&) {
+    throw std::runtime_error("Isolated execution is not supported on this platform.");
+}
+
+#endif // LITETEST_HAS_FORK
+
+} // litetest::internal
@@ -1,239 +1,1212 @@
 #include "litetest.h"
+#include "runner.h"
 
 #include <iostream>
 #include <stdexcept>
 #include <vector>
 #include <unordered_map>
 #include <algorithm>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <string_view>
+#include <utility>
+#include <tuple>
+#include <iterator>
+#include <iomanip>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <random>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
 
 namespace litetest {
 namespace internal {
 
-static void initialize();
+// Registrations of the program, and the registry registrations currently go
+// to. Being constant-initialized, they are valid before any registration
+// constructor runs, whatever the order in which translation units are
+// initialized.
+static Registry s_program_registry;
+static Registry* s_registry = &s_program_registry;
 
-static std::vector<TestCase>* s_cases = []() {
-    initialize();
-    return s_cases;
-}();
+Registry* set_registry(Registry* registry) {
+    return std::exchange(s_registry, registry);
+}
 
-static std::vector<TestSuite>* s_suites = []() {
-    initialize();
-    return s_suites;
-}();
+CaseRegistration::CaseRegistration(std::string_view name,
+                                   void (*function)(),
+                                   std::string_view src_file,
+                                   int line,
+                                   CaseKind kind,
+                                   double timeout,
+                                   int stress_threads,
+                                   int64_t stress_iterations)
+    : name(name), function(function), make_params(nullptr), start_async(nullptr), src_file(src_file), line(line),
+      kind(kind), timeout(timeout), stress_threads(stress_threads), stress_iterations(stress_iterations),
+      next(s_registry->cases) {
+    s_registry->cases = this;
+}
 
-static std::unordered_map<std::string, std::function<void()>>* s_setups = []() {
-    initialize();
-    return s_setups;
-}();
+CaseRegistration::CaseRegistration(std::string_view name,
+                                   std::unique_ptr<CaseParams> (*make_params)(),
+                                   std::string_view src_file,
+                                   int line)
+    : name(name), function(nullptr), make_params(make_params), start_async(nullptr), src_file(src_file), line(line),
+      kind(CaseKind::TEST), timeout(0), stress_threads(0), stress_iterations(0), next(s_registry->cases) {
+    s_registry->cases = this;
+}
 
-static std::unordered_map<std::string, std::function<void()>>* s_cleanups = []() {
-    initialize();
-    return s_cleanups;
-}();
+CaseRegistration::CaseRegistration(std::string_view name,
+                                   AsyncCoroutine (*start_async)(),
+                                   std::string_view src_file,
+                                   int line)
+    : name(name), function(nullptr), make_params(nullptr), start_async(start_async), src_file(src_file), line(line),
+      kind(CaseKind::ASYNC), timeout(0), stress_threads(0), stress_iterations(0), next(s_registry->cases) {
+    s_registry->cases = this;
+}
 
-static void initialize() {
-    if (!s_suites) {
-        s_suites = new std::vector<TestSuite>();
+SuiteRegistration::SuiteRegistration(std::string_view name,
+                                     std::string_view src_file,
+                                     int line)
+    : name(name), src_file(src_file), line(line),
+      next(s_registry->suites) {
+    s_registry->suites = this;
+}
+
+HookRegistration::HookRegistration(std::string_view suite_name,
+                                   std::string_view src_file,
+                                   void (*function)(),
+                                   SuiteHook hook)
+    : suite_name(suite_name), src_file(src_file), function(function), hook(hook),
+      next(s_registry->hooks) {
+    s_registry->hooks = this;
+}
+
+/**
+ * Returns the registrations of a list in the order they were made.
+ */
+template <typename T>
+static std::vector<const T*> registration_list(const T* head) {
+    std::vector<const T*> list;
+    for (const T* node = head; node; node = node->next) {
+        list.push_back(node);
     }
-    if (!s_cases) {
-        s_cases = new std::vector<TestCase>();
+    std::reverse(list.begin(), list.end());
+    return list;
+}
+
+static bool declared_before(const TestSuite* suite, std::string_view src_file, int line) {
+    int cmp = std::string_view(suite->src_file).compare(src_file);
+    return cmp < 0 || (cmp == 0 && suite->line <= line);
+}
+
+/**
+ * Returns the last suite declared before the given location in the same file,
+ * given suites sorted by file and line.
+ */
+static TestSuite* find_matching_suite(const std::vector<TestSuite*>& sorted_suites,
+                                      std::string_view src_file,
+                                      int line) {
+    auto it = std::partition_point(sorted_suites.begin(), sorted_suites.end(), [&](const TestSuite* suite) {
+        return declared_before(suite, src_file, line);
+    });
+    if (it == sorted_suites.begin()) {
+        return nullptr;
     }
-    if (!s_setups) {
-        s_setups = new std::unordered_map<std::string, std::function<void()>>();
+    TestSuite* suite = *std::prev(it);
+    return suite->src_file == src_file ? suite : nullptr;
+}
+
+/**
+ * Compares suites and file names by file name only.
+ */
+struct SuiteFileLess {
+    bool operator()(const TestSuite* suite, std::string_view src_file) const {
+        return std::string_view(suite->src_file) < src_file;
+    }
+    bool operator()(std::string_view src_file, const TestSuite* suite) const {
+        return src_file < std::string_view(suite->src_file);
     }
-    if (!s_cleanups) {
-        s_cleanups = new std::unordered_map<std::string, std::function<void()>>();
+};
+
+/** Suites and cases built by process_suites(). */
+struct BuiltSuites {
+    // Deques, so that pointers to elements stay valid as more are added.
+    std::deque<TestSuite> suites;
+    std::deque<TestCase> cases;
+    std::vector<TestSuite*> processed;
+};
+
+static BuiltSuites* s_built = nullptr;
+
+/**
+ * Builds the suites and cases out of the registrations of a registry.
+ * Cases and hooks only match suites of their own registry.
+ */
+static void build_suites(const Registry& registry, BuiltSuites& built) {
+    auto suite_registrations = registration_list<SuiteRegistration>(registry.suites);
+    auto case_registrations = registration_list<CaseRegistration>(registry.cases);
+
+    std::vector<TestSuite*> suites;
+    for (const SuiteRegistration* reg: suite_registrations) {
+        TestSuite& suite = built.suites.emplace_back();
+        suite.name = reg->name;
+        suite.src_file = reg->src_file;
+        suite.line = reg->line;
+        suites.push_back(&suite);
     }
+
+    std::vector<TestSuite*> sorted_suites = suites;
+    std::sort(sorted_suites.begin(), sorted_suites.end(), [](const TestSuite* a, const TestSuite* b) {
+        return std::tie(a->src_file, a->line) < std::tie(b->src_file, b->line);
+    });
+
+    for (const CaseRegistration* reg: case_registrations) {
+        TestSuite* suite = find_matching_suite(sorted_suites, reg->src_file, reg->line);
+        if (suite == nullptr) {
+            throw std::runtime_error("Test case " + std::string(reg->name) + " has no suite.");
+        }
+
+        TestCase& test_case = built.cases.emplace_back();
+        test_case.name = reg->name;
+        if (reg->function) {
+            test_case.function = reg->function;
+        }
+        test_case.make_params = reg->make_params;
+        test_case.start_async = reg->start_async;
+        test_case.src_file = reg->src_file;
+        test_case.line = reg->line;
+        test_case.kind = reg->kind;
+        test_case.timeout = reg->timeout;
+        test_case.stress_threads = reg->stress_threads;
+        test_case.stress_iterations = reg->stress_iterations;
+        suite->cases.push_back(&test_case);
+    }
+
+    for (const HookRegistration* reg: registration_list<HookRegistration>(registry.hooks)) {
+        // Hooks refer to suites of their own file.
+        auto [first, last] = std::equal_range(sorted_suites.begin(), sorted_suites.end(), reg->src_file,
+                                              SuiteFileLess());
+        for (auto it = first; it != last; ++it) {
+            TestSuite* suite = *it;
+            if (suite->name != reg->suite_name) {
+                continue;
+            }
+            if (reg->hook == SuiteHook::SETUP) {
+                suite->setup = reg->function;
+            }
+            else {
+                suite->cleanup = reg->function;
+            }
+        }
+    }
+    built.processed.insert(built.processed.end(), suites.begin(), suites.end());
 }
 
-TestCase* push_case(const std::string& name,
-                    std::function<void()> fn,
-                    const std::string& src_file,
-                    int line) {
-    initialize();
-    s_cases->push_back({name, std::move(fn), src_file, line,});
-    return &*(s_cases->rbegin());
+std::vector<TestSuite*> process_suites() {
+    // Registrations only change as modules are loaded or unloaded, which
+    // discards the suites, so they're only built once in between.
+    if (!s_built) {
+        auto built = std::make_unique<BuiltSuites>();
+        build_suites(s_program_registry, *built);
+        for (const Registry* registry: module_registries()) {
+            build_suites(*registry, *built);
+        }
+        s_built = built.release();
+    }
+    return s_built->processed;
+}
+
+void discard_suites() {
+    delete std::exchange(s_built, nullptr);
+}
+
+void ExecutionContext::report_helper_failure(std::exception_ptr failure) {
+    std::lock_guard lock(helper_mutex);
+    if (!helper_failure) {
+        helper_failure = std::move(failure);
+    }
 }
 
-TestSuite* push_suite(const std::string& name,
-                      const std::string& src_file,
-                      int line) {
-    initialize();
-    s_suites->push_back({name, src_file, line});
-    return &*(s_suites->rbegin());
+void ExecutionContext::rethrow_helper_failure() {
+    std::exception_ptr failure;
+    {
+        std::lock_guard lock(helper_mutex);
+        failure = std::exchange(helper_failure, nullptr);
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
 }
 
-std::function<void()> push_suite_setup(const std::string& suite_name,
-                                       const std::string& suite_file,
-                                       std::function<void()> setup) {
-    initialize();
-    (*s_setups)[suite_file + "/" + suite_name] = setup;
-    return setup;
+ContextScope::ContextScope(const TestSuite* suite, const TestCase* test_case)
+    : m_previous(t_context) {
+    m_owned.emplace();
+    m_owned->suite = suite;
+    m_owned->test_case = test_case;
+    m_owned->parent = t_context;
+    t_context = &*m_owned;
 }
 
-std::function<void()> push_suite_cleanup(const std::string& suite_name,
-                                         const std::string& suite_file,
-                                         std::function<void()> cleanup) {
-    initialize();
-    (*s_cleanups)[suite_file + "/" + suite_name] = cleanup;
-    return cleanup;
+ContextScope::ContextScope(ExecutionContext* context)
+    : m_previous(t_context) {
+    t_context = context;
 }
 
-using FileSuiteMap = std::unordered_map<std::string, std::vector<TestSuite*>>;
+ContextScope::~ContextScope() {
+    t_context = m_previous;
+}
 
-static FileSuiteMap generate_file_suite_map() {
-    FileSuiteMap suites_by_file;
-    for (auto& suite: *s_suites) {
-        suites_by_file[suite.src_file].push_back(&suite);
+const TestCase& current_case() {
+    for (const ExecutionContext* context = t_context; context; context = context->parent) {
+        if (context->test_case) {
+            return *context->test_case;
+        }
     }
+    throw std::logic_error("No test case is currently running on this thread.");
+}
+
+const TestSuite& current_suite() {
+    for (const ExecutionContext* context = t_context; context; context = context->parent) {
+        if (context->suite) {
+            return *context->suite;
+        }
+    }
+    throw std::logic_error("No test suite is currently running on this thread.");
+}
+
+static std::atomic<int64_t> s_merged_assertions = 0;
+
+AssertionCounter::~AssertionCounter() {
+    s_merged_assertions += count;
+}
+
+int64_t assertion_count() {
+    return s_merged_assertions + t_assertions.count;
+}
+
+void add_assertions(int64_t count) {
+    s_merged_assertions += count;
+}
+
+void throw_failure(const std::string& message, int line) {
+    throw TestFailure(message, current_case().name, current_suite().name, line);
+}
+
+} // internal
+using namespace internal;
+
+static bool has_suite_in_args(const RunTestsArgs& args,
+                              const std::string& suite_name) {
+    return args.suites.empty() ||
+           std::any_of(args.suites.begin(), args.suites.end(), [&suite_name](const std::string& name) {
+               return name == suite_name;
+           });
+}
+
+namespace {
+
+/**
+ * Fixed-size pool of worker threads consuming tasks from a FIFO queue.
+ * Tasks may submit further tasks to the pool they are running on.
+ */
+class WorkerPool {
+public:
+    explicit WorkerPool(int n_workers);
+    ~WorkerPool();
+
+    void submit(std::function<void()> task);
+
+    /** Blocks until the queue is empty and no worker is running a task. */
+    void wait();
+
+private:
+    void worker_loop();
+
+    std::mutex m_mutex;
+    std::condition_variable m_task_cv;
+    std::condition_variable m_idle_cv;
+    std::deque<std::function<void()>> m_tasks;
+    std::vector<std::thread> m_threads;
+    int m_busy = 0;
+    bool m_stop = false;
+};
+
+WorkerPool::WorkerPool(int n_workers) {
+    for (int i = 0; i < n_workers; ++i) {
+        m_threads.emplace_back([this]() { worker_loop(); });
+    }
+}
 
-    for (auto& kv: suites_by_file) {
-        std::sort(kv.second.begin(), kv.second.end(), [](auto a, auto b) {
-            return a->line < b->line;
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_task_cv.notify_all();
+    for (std::thread& thread: m_threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_task_cv.notify_one();
+}
+
+void WorkerPool::wait() {
+    std::unique_lock lock(m_mutex);
+    m_idle_cv.wait(lock, [this]() {
+        return m_tasks.empty() && m_busy == 0;
+    });
+}
+
+void WorkerPool::worker_loop() {
+    std::unique_lock lock(m_mutex);
+    while (true) {
+        m_task_cv.wait(lock, [this]() {
+            return m_stop || !m_tasks.empty();
         });
+        if (m_tasks.empty()) {
+            // Stopping and nothing left to do.
+            return;
+        }
+
+        std::function<void()> task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        m_busy++;
+
+        lock.unlock();
+        task();
+        lock.lock();
+
+        m_busy--;
+        if (m_tasks.empty() && m_busy == 0) {
+            m_idle_cv.notify_all();
+        }
     }
-    return suites_by_file;
 }
 
-static TestSuite* find_matching_suite(const FileSuiteMap& suites_by_file,
-                                      const std::string& file_name,
-                                      int line) {
-    auto it = suites_by_file.find(file_name);
-    if (it != suites_by_file.end()) {
-        auto& vec = it->second;
-        if (vec.begin() == vec.end()) {
-            // Empty vector, no suites.
-            return nullptr;
-        }
-        TestSuite* matching_suite = nullptr;
-        for (TestSuite* suite: vec) {
-            if (suite->line > line) {
-                // Suite was declared after the test case.
-                // Since the vector is sorted, we can assume that all
-                // further suites also fall into this condition, so we abort.
+} // namespace
+
+namespace internal {
+
+double thread_cpu_seconds() {
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    // FILETIMEs are expressed in 100 nanosecond units.
+    auto to_ticks = [](const FILETIME& ft) {
+        return (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    };
+    return double(to_ticks(kernel) + to_ticks(user)) * 1e-7;
+#else
+    timespec ts {};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+#endif
+}
+
+RunState::RunState(const RunTestsArgs& args)
+    : m_args(args) {
+    if (!args.reporter.empty()) {
+        m_reporter = make_reporter(args.reporter, args.report_file);
+    }
+}
+
+int RunState::n_cases_started() {
+    std::lock_guard lock(m_mutex);
+    return m_n_cases_started + int(m_started_params.size());
+}
+
+void RunState::new_repetition() {
+    std::lock_guard lock(m_mutex);
+    m_n_cases_started += int(m_started_params.size());
+    m_started_params.clear();
+}
+
+void RunState::finish() {
+    std::lock_guard lock(m_mutex);
+    if (m_reporter) {
+        m_reporter->run_finished(results);
+    }
+}
+
+static void print_captured(std::ostream& out, const char* stream_name, const std::string& output) {
+    if (output.empty()) {
+        return;
+    }
+    out << "Captured " << stream_name << ":\n" << output;
+    if (output.back() != '\n') {
+        out << '\n';
+    }
+}
+
+void RunState::record(const CaseResult& result) {
+    std::lock_guard lock(m_mutex);
+    results.n_cases_executed++;
+    if (result.test_case->instance_of) {
+        m_started_params.insert(result.test_case->instance_of);
+    }
+    else {
+        m_n_cases_started++;
+    }
+    suite_seconds[result.suite] += result.time.wall_seconds;
+
+    CaseReport report;
+    report.suite = result.suite->name;
+    report.name = result.test_case->name;
+    report.src_file = result.test_case->src_file;
+    report.line = result.test_case->line;
+    report.status = result.status;
+    report.time = result.time;
+    report.n_assertions = result.n_assertions;
+    report.n_checks_skipped = result.n_checks_skipped;
+    results.n_checks_skipped += result.n_checks_skipped;
+    report.benchmark = result.benchmark;
+    report.allocations = result.allocations;
+    report.stress = result.stress;
+    report.message = result.message;
+    report.failure_line = result.line;
+    if (result.status != CaseStatus::PASSED && ++m_n_failures == m_args.max_failures) {
+        m_cancellation.cancel();
+    }
+    report.captured_stdout = result.captured_stdout;
+    report.captured_stderr = result.captured_stderr;
+    if (m_args.case_time_budget > 0 && result.time.wall_seconds > m_args.case_time_budget) {
+        report.over_budget = true;
+        results.n_cases_over_budget++;
+        std::cout << "Test case '" << report.name << "' took " << result.time.wall_seconds * 1000
+                  << " ms, over the budget of " << m_args.case_time_budget * 1000 << " ms.\n";
+    }
+    if (result.allocations) {
+        results.n_allocations += result.allocations->allocations;
+        results.n_bytes_allocated += result.allocations->bytes;
+        if (result.allocations->leaked_bytes > 0) {
+            results.n_cases_leaking++;
+            std::cout << "Test case '" << report.name << "' leaked " << result.allocations->leaked_bytes
+                      << " bytes.\n";
+        }
+    }
+    if (m_reporter) {
+        m_reporter->case_finished(report);
+    }
+    results.cases.push_back(std::move(report));
+
+    const std::string& name = result.test_case->name;
+    switch (result.status) {
+        case CaseStatus::PASSED:
+            results.n_cases_passed++;
+            break;
+        case CaseStatus::FAILED:
+            std::cout << "Test case '" << name << "' (assertion at line " << result.line << ") failed:\n\t" << result.message << '\n';
+            break;
+        case CaseStatus::INCOMPLETE:
+            std::cerr << "Test case '" << name << "' threw an unexpected exception:\n" << result.message << '\n';
+            results.n_cases_incomplete++;
+            break;
+        case CaseStatus::CRASHED:
+            std::cerr << "Test case '" << name << "' crashed:\n" << result.message << '\n';
+            results.n_cases_crashed++;
+            break;
+        case CaseStatus::TIMED_OUT:
+            std::cerr << "Test case '" << name << "' timed out:\n" << result.message << '\n';
+            results.n_cases_timed_out++;
+            break;
+    }
+    if (result.status != CaseStatus::PASSED) {
+        std::ostream& out = result.status == CaseStatus::FAILED ? std::cout : std::cerr;
+        print_captured(out, "stdout", result.captured_stdout);
+        print_captured(out, "stderr", result.captured_stderr);
+    }
+}
+
+SuiteReport& RunState::suite_report(const TestSuite* suite) {
+    auto it = m_suite_reports.find(suite);
+    if (it != m_suite_reports.end()) {
+        return results.suites[it->second];
+    }
+
+    m_suite_reports[suite] = results.suites.size();
+    SuiteReport& report = results.suites.emplace_back();
+    report.name = suite->name;
+    report.src_file = suite->src_file;
+    report.line = suite->line;
+    return report;
+}
+
+static void accumulate(Timing& total, const Timing& time) {
+    total.wall_seconds += time.wall_seconds;
+    total.cpu_seconds += time.cpu_seconds;
+}
+
+void RunState::record_setup(const TestSuite* suite, const Timing& time) {
+    std::lock_guard lock(m_mutex);
+    suite_seconds[suite] += time.wall_seconds;
+    accumulate(suite_report(suite).setup, time);
+}
+
+void RunState::record_cleanup(const TestSuite* suite, const Timing& time) {
+    std::lock_guard lock(m_mutex);
+    suite_seconds[suite] += time.wall_seconds;
+    accumulate(suite_report(suite).cleanup, time);
+}
+
+void RunState::abandon(const std::optional<CaseResult>& result, const std::string& reason) {
+    if (result) {
+        record(*result);
+    }
+    std::cerr << "Abandoning the run. " << reason << std::endl;
+    finish();
+
+    {
+        std::lock_guard lock(m_mutex);
+        std::cout << results.n_cases_passed << " of " << results.n_cases_executed
+                  << " passed before the run was abandoned." << std::endl;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    std::fflush(stderr);
+    // Whatever hung can't be unwound, so don't wait for it.
+    std::_Exit(EXIT_FAILURE);
+}
+
+void RunState::set_fatal_error(std::exception_ptr error) {
+    std::lock_guard lock(m_mutex);
+    if (!m_fatal_error) {
+        m_fatal_error = std::move(error);
+    }
+}
+
+void RunState::rethrow_fatal_error() const {
+    if (m_fatal_error) {
+        std::rethrow_exception(m_fatal_error);
+    }
+}
+
+CaseResult execute_case(TestSuite* suite,
+                        TestCase* test_case,
+                        const RunTestsArgs& args,
+                        OutputCapture* capture,
+                        const CancellationToken* cancellation,
+                        const StreamCapture* stream_capture) {
+    ContextScope scope(suite, test_case);
+    scope.context().cancellation = cancellation;
+    scope.context().args = &args;
+    scope.context().worker = std::this_thread::get_id();
+    if (capture) {
+        capture->begin();
+    }
+    std::optional<CapturedOutput> captured_output;
+    if (stream_capture) {
+        scope.context().captured_output = &captured_output.emplace();
+    }
+
+    CaseResult result;
+    result.suite = suite;
+    result.test_case = test_case;
+    int64_t initial_assertion_count = t_assertions.count;
+    // Allocations of benchmarks mostly tell about how many iterations ran.
+    bool track_allocations = args.track_allocations && test_case->kind == CaseKind::TEST;
+    int stress_threads = test_case->stress_threads > 0 ? test_case->stress_threads : args.stress_threads;
+    AllocationCounters& allocation_counters = t_allocations;
+    AllocationCounters initial_allocations = allocation_counters;
+    allocation_counters.peak_live_bytes = allocation_counters.live_bytes;
+    Stopwatch stopwatch;
+    try {
+        if (test_case->kind == CaseKind::BENCHMARK) {
+            result.benchmark = measure_benchmark(test_case->function,
+                                                 args.benchmark_sample_time,
+                                                 args.benchmark_samples);
+        }
+        else if (stress_threads > 0 && test_case->kind == CaseKind::TEST) {
+            result.stress.emplace();
+            run_stress(test_case->function, stress_threads,
+                       test_case->stress_iterations > 0 ? test_case->stress_iterations : args.stress_iterations,
+                       args.stress_seconds, *result.stress);
+        }
+        else {
+            test_case->function();
+        }
+        scope.context().rethrow_helper_failure();
+    }
+    catch (const TestFailure& test_failure) {
+        result.status = CaseStatus::FAILED;
+        result.message = test_failure.what();
+        result.line = test_failure.line;
+    }
+    catch (const std::exception& e) {
+        result.status = CaseStatus::INCOMPLETE;
+        result.message = e.what();
+    }
+    catch (...) {
+        if (capture) {
+            capture->end();
+        }
+        throw;
+    }
+    result.time = stopwatch.elapsed();
+    if (track_allocations) {
+        result.allocations = allocations_since(initial_allocations);
+        if (result.status != CaseStatus::PASSED) {
+            result.allocations->leaked_bytes = 0;
+        }
+    }
+    result.n_assertions = int(t_assertions.count - initial_assertion_count + scope.context().helper_assertions);
+    result.n_checks_skipped = scope.context().skipped_checks;
+
+    if (capture) {
+        capture->end();
+        if (result.status != CaseStatus::PASSED) {
+            capture->read(result.captured_stdout, result.captured_stderr);
+            test_case->cout.str(result.captured_stdout);
+            test_case->cerr.str(result.captured_stderr);
+        }
+    }
+    if (captured_output && result.status != CaseStatus::PASSED) {
+        result.captured_stdout = std::move(captured_output->out);
+        result.captured_stderr = std::move(captured_output->err);
+        test_case->cout.str(result.captured_stdout);
+        test_case->cerr.str(result.captured_stderr);
+    }
+    return result;
+}
+
+std::unique_ptr<TestCase> make_instance(const TestCase& of, const std::string& label, std::function<void()> run) {
+    auto instance = std::make_unique<TestCase>();
+    instance->name = of.name + "[" + label + "]";
+    instance->function = std::move(run);
+    instance->src_file = of.src_file;
+    instance->line = of.line;
+    instance->kind = of.kind;
+    instance->timeout = of.timeout;
+    instance->stress_threads = of.stress_threads;
+    instance->stress_iterations = of.stress_iterations;
+    instance->instance_of = &of;
+    return instance;
+}
+
+InstanceCursor::InstanceCursor(TestCase* test_case, std::function<bool(const TestCase&)> select, size_t first)
+    : m_test_case(test_case), m_select(std::move(select)), m_next(first) {}
+
+std::unique_ptr<TestCase> InstanceCursor::next(size_t* index) {
+    std::lock_guard lock(m_mutex);
+    while (!m_done) {
+        try {
+            if (!m_test_case->params) {
+                m_test_case->params = m_test_case->make_params();
+            }
+            std::optional<CaseInput> input = m_test_case->params->input(m_next);
+            if (!input) {
+                m_done = true;
                 break;
             }
-            matching_suite = suite;
+            size_t i = m_next++;
+            std::unique_ptr<TestCase> instance = make_instance(*m_test_case, input->label, std::move(input->run));
+            if (!m_select || m_select(*instance)) {
+                if (index) {
+                    *index = i;
+                }
+                return instance;
+            }
+        }
+        catch (...) {
+            m_done = true;
+            throw;
         }
-        return matching_suite;
     }
     return nullptr;
 }
 
-static void arrange_suites_and_functions(const FileSuiteMap& suites_by_file) {
-    for (auto& suite: *s_suites) {
-        // Fallback to empty functions.
-        suite.setup = []() {};
-        suite.cleanup = []() {};
+CaseResult inputs_failure(const TestSuite* suite, const TestCase* test_case, const std::exception& error) {
+    CaseResult result;
+    result.suite = suite;
+    result.test_case = test_case;
+    result.status = CaseStatus::INCOMPLETE;
+    result.message = std::string("Failed to create the inputs of the case: ") + error.what();
+    return result;
+}
 
-        std::string fn_identifier = suite.src_file + "/" + suite.name;
+} // internal
 
-        auto setups_it = s_setups->find(fn_identifier);
-        if (setups_it != s_setups->end()) {
-            suite.setup = setups_it->second;
+bool cancellation_requested() {
+    for (const ExecutionContext* context = t_context; context; context = context->parent) {
+        if (context->cancellation) {
+            return context->cancellation->cancelled();
         }
+    }
+    return false;
+}
+
+static void run_case(RunState& state, TestSuite* suite, TestCase* test_case,
+                     OutputCapture* capture = nullptr) {
+    CaseResult result;
+    {
+        WatchScope watch(state.watchdog, suite, test_case, case_time_limit(*test_case, state.args()));
+        result = execute_case(suite, test_case, state.args(), capture, &state.cancellation(),
+                              state.stream_capture);
+    }
+    state.record(result);
+}
 
-        auto cleanups_it = s_cleanups->find(fn_identifier);
-        if (cleanups_it != s_cleanups->end()) {
-            suite.cleanup = cleanups_it->second;
+/**
+ * Runs instances of a parameterized case until the cursor runs out of them
+ * or the run is cancelled.
+ */
+static void run_instances(RunState& state, TestSuite* suite, InstanceCursor& cursor,
+                          OutputCapture* capture = nullptr) {
+    while (!state.cancelled()) {
+        std::unique_ptr<TestCase> instance;
+        try {
+            instance = cursor.next();
+        }
+        catch (const std::exception& e) {
+            state.record(inputs_failure(suite, cursor.test_case(), e));
+            return;
         }
+        if (!instance) {
+            return;
+        }
+        run_case(state, suite, instance.get(), capture);
     }
 }
 
-static void arrange_cases_and_suites(FileSuiteMap& suites_by_file) {
-    for (auto& test_case: *s_cases) {
-        TestSuite* selected_suite = find_matching_suite(suites_by_file,
-                                                        test_case.src_file,
-                                                        test_case.line);
+static void run_suite_setup(RunState& state, TestSuite* suite) {
+    Stopwatch stopwatch;
+    ContextScope scope(suite, nullptr);
+    suite->setup();
+    state.record_setup(suite, stopwatch.elapsed());
+}
 
-        if (selected_suite == nullptr) {
-            throw std::runtime_error(std::string("Test case ") + test_case.name + " has no suite.");
-        }
+static void run_suite_cleanup(RunState& state, TestSuite* suite) {
+    Stopwatch stopwatch;
+    {
+        ContextScope scope(suite, nullptr);
+        FixtureTeardown teardown(suite);
+        suite->cleanup();
+    }
+    state.record_cleanup(suite, stopwatch.elapsed());
+}
 
-        selected_suite->cases.push_back(&test_case);
+/**
+ * Runs consecutive asynchronous cases of a suite together on an event loop.
+ */
+static void run_async_cases(RunState& state, TestSuite* suite, const std::vector<TestCase*>& cases) {
+    execute_async_cases(suite, cases, state.args(), &state.cancellation(), [&state](const CaseResult& result) {
+        state.record(result);
+    }, state.watchdog);
+}
+
+/**
+ * Splits the cases of a suite into units of work: single cases, or
+ * consecutive asynchronous cases, which are multiplexed on one thread.
+ */
+static std::vector<std::vector<TestCase*>> work_units(const std::vector<TestCase*>& cases) {
+    std::vector<std::vector<TestCase*>> units;
+    for (TestCase* test_case: cases) {
+        bool async = test_case->kind == CaseKind::ASYNC;
+        if (async && !units.empty() && units.back().back()->kind == CaseKind::ASYNC) {
+            units.back().push_back(test_case);
+        }
+        else {
+            units.push_back({ test_case });
+        }
     }
+    return units;
 }
 
-std::vector<TestSuite*> process_suites() {
-    FileSuiteMap suites_by_file = generate_file_suite_map();
+static void run_unit(RunState& state, const SuiteRun& run, const std::vector<TestCase*>& unit,
+                     OutputCapture* capture = nullptr) {
+    if (unit.front()->kind == CaseKind::ASYNC) {
+        run_async_cases(state, run.suite, unit);
+    }
+    else if (unit.front()->make_params) {
+        InstanceCursor cursor(unit.front(), run.select_instance);
+        run_instances(state, run.suite, cursor, capture);
+    }
+    else {
+        run_case(state, run.suite, unit.front(), capture);
+    }
+}
 
-    arrange_cases_and_suites(suites_by_file);
-    arrange_suites_and_functions(suites_by_file);
+static void run_suite_serial(RunState& state, const SuiteRun& run,
+                             OutputCapture* capture = nullptr) {
+    WatchScope watch(state.watchdog, run.suite, nullptr, state.args().suite_timeout);
+    run_suite_setup(state, run.suite);
 
-    std::vector<TestSuite*> suites;
-    for (auto& suite: *s_suites) {
-        suites.push_back(&suite);
+    for (const std::vector<TestCase*>& unit: work_units(run.cases)) {
+        if (state.cancelled()) {
+            break;
+        }
+        run_unit(state, run, unit, capture);
     }
-    return suites;
+
+    run_suite_cleanup(state, run.suite);
 }
 
-static std::unordered_map<std::thread::id, TestCase*> s_current_case;
-static std::unordered_map<std::thread::id, TestSuite*> s_current_suite;
+/**
+ * Runs the suite's setup on the calling thread and then hands each of its
+ * cases to the pool. The instances of a parameterized case are shared out
+ * between as many tasks as there are workers. Whichever worker finishes the
+ * last task runs the cleanup.
+ */
+static void run_suite_parallel(RunState& state, const SuiteRun& run, WorkerPool& pool) {
+    TestSuite* suite = run.suite;
+    // The suite outlives this call, so it is unwatched by whoever runs the cleanup.
+    Watchdog* watchdog = state.watchdog;
+    uint64_t watch_id = watchdog ? watchdog->watch(suite, nullptr, state.args().suite_timeout) : 0;
+    run_suite_setup(state, suite);
+
+    if (run.cases.empty()) {
+        run_suite_cleanup(state, suite);
+        if (watchdog) {
+            watchdog->unwatch(watch_id);
+        }
+        return;
+    }
 
-const TestCase& current_case(std::thread::id thread_id) {
-    return *s_current_case.at(thread_id);
+    std::vector<std::function<void()>> tasks;
+    for (std::vector<TestCase*>& unit: work_units(run.cases)) {
+        if (unit.front()->make_params) {
+            auto cursor = std::make_shared<InstanceCursor>(unit.front(), run.select_instance);
+            for (int i = 0; i < std::max(1, state.args().jobs); ++i) {
+                tasks.push_back([&state, suite, cursor]() { run_instances(state, suite, *cursor); });
+            }
+        }
+        else {
+            tasks.push_back([&state, &run, unit = std::move(unit)]() { run_unit(state, run, unit); });
+        }
+    }
+
+    auto remaining = std::make_shared<std::atomic_size_t>(tasks.size());
+    for (std::function<void()>& task: tasks) {
+        pool.submit([&state, suite, task = std::move(task), remaining, watchdog, watch_id]() {
+            try {
+                // Tasks queued before a cancellation are dropped, but still
+                // count towards running the cleanup.
+                if (!state.cancelled()) {
+                    task();
+                }
+            }
+            catch (...) {
+                state.set_fatal_error(std::current_exception());
+            }
+
+            if (--*remaining == 0) {
+                try {
+                    run_suite_cleanup(state, suite);
+                }
+                catch (...) {
+                    state.set_fatal_error(std::current_exception());
+                }
+                if (watchdog) {
+                    watchdog->unwatch(watch_id);
+                }
+            }
+        });
+    }
 }
 
-const TestSuite& current_suite(std::thread::id thread_id) {
-    return *s_current_suite.at(thread_id);
+/** A seed for runs that weren't given one. Never 0. */
+static uint64_t random_seed() {
+    std::random_device device;
+    uint64_t seed = (uint64_t(device()) << 32) ^ device();
+    return seed ? seed : 1;
 }
 
-std::atomic_int g_assert_count = 0;
+static bool has_time_limits(const std::vector<SuiteRun>& runs, const RunTestsArgs& args) {
+    if (args.case_timeout > 0 || args.suite_timeout > 0) {
+        return true;
+    }
+    for (const SuiteRun& run: runs) {
+        for (const TestCase* test_case: run.cases) {
+            if (test_case->timeout > 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-} // internal
-using namespace internal;
+/**
+ * Shuffles suites, and the cases of each suite, in an order derived from
+ * the run's seed which differs between repetitions.
+ */
+static void shuffle_runs(std::vector<SuiteRun>& runs, uint64_t seed, int repetition) {
+    std::mt19937_64 random(seed + uint64_t(repetition) * 0x9e3779b97f4a7c15ull);
+    std::shuffle(runs.begin(), runs.end(), random);
+    for (SuiteRun& run: runs) {
+        std::shuffle(run.cases.begin(), run.cases.end(), random);
+    }
+}
 
-static bool has_suite_in_args(const RunTestsArgs& args,
-                              const std::string& suite_name) {
-    return args.suites.empty() ||
-           std::any_of(args.suites.begin(), args.suites.end(), [&suite_name](const std::string& name) {
-               return name == suite_name;
-           });
+/**
+ * Executes the given suite runs once, with whichever runner the arguments ask for.
+ */
+static void execute_runs(RunState& state, const std::vector<SuiteRun>& runs, const RunTestsArgs& args) {
+    if (args.isolated) {
+        run_suites_isolated(state, runs, args);
+    }
+    else if (args.jobs <= 1) {
+        std::optional<OutputCapture> capture;
+        if (args.capture_output) {
+            capture.emplace();
+        }
+        std::optional<Watchdog> watchdog;
+        if (has_time_limits(runs, args)) {
+            state.watchdog = &watchdog.emplace(state, capture ? &*capture : nullptr);
+        }
+        for (const SuiteRun& run: runs) {
+            if (state.cancelled()) {
+                break;
+            }
+            run_suite_serial(state, run, capture ? &*capture : nullptr);
+        }
+        state.watchdog = nullptr;
+    }
+    else {
+        std::optional<Watchdog> watchdog;
+        if (has_time_limits(runs, args)) {
+            state.watchdog = &watchdog.emplace(state, nullptr);
+        }
+        std::optional<StreamCapture> stream_capture;
+        if (args.capture_output) {
+            state.stream_capture = &stream_capture.emplace();
+        }
+        WorkerPool pool(args.jobs);
+        for (const SuiteRun& run: runs) {
+            pool.submit([&state, &pool, &args, &run]() {
+                if (state.cancelled()) {
+                    return;
+                }
+                try {
+                    if (args.parallel_cases) {
+                        run_suite_parallel(state, run, pool);
+                    }
+                    else {
+                        run_suite_serial(state, run);
+                    }
+                }
+                catch (...) {
+                    state.set_fatal_error(std::current_exception());
+                }
+            });
+        }
+        pool.wait();
+        state.watchdog = nullptr;
+        state.stream_capture = nullptr;
+    }
 }
 
 RunTestsResults run_tests(RunTestsArgs args) {
-    RunTestsResults results;
+    if (args.seed == 0) {
+        args.seed = random_seed();
+    }
+    RunState state(args);
+    state.results.seed = args.seed;
+    int64_t initial_assertion_count = assertion_count();
 
     auto suites = process_suites();
+    std::vector<TestSuite*> selected_suites;
     for (TestSuite* suite: suites) {
         // We might want to skip some suites if the user says so.
-        if (!has_suite_in_args(args, suite->name)) {
-            continue;
+        if (has_suite_in_args(args, suite->name)) {
+            selected_suites.push_back(suite);
         }
+    }
+
+    if (args.shard_count < 1) {
+        throw std::invalid_argument("There must be at least one shard.");
+    }
+    if (args.shard_index < 0 || args.shard_index >= args.shard_count) {
+        throw std::invalid_argument("Shard index " + std::to_string(args.shard_index) + " is out of range, with " +
+                                    std::to_string(args.shard_count) + " shard(s).");
+    }
+    SuiteTimings timings;
+    if (!args.timings_file.empty()) {
+        timings = load_suite_timings(args.timings_file);
+    }
+    if (args.shard_count > 1) {
+        selected_suites = select_shard(selected_suites, args.shard_index, args.shard_count, timings);
+    }
 
-        s_current_suite[std::this_thread::get_id()] = suite;
-        suite->setup();
+    if (args.benchmarks && args.isolated) {
+        throw std::invalid_argument("Benchmarks cannot be run in isolated mode.");
+    }
+    if (args.repeat <= 0 && !args.until_fail) {
+        throw std::invalid_argument("Cases must be repeated at least once.");
+    }
+    if (args.track_allocations && !g_allocation_hooks) {
+        throw std::invalid_argument("Tracking allocations requires linking the litetest_allocs library.");
+    }
+    if (args.stress_threads > 0 && args.stress_iterations <= 0 && args.stress_seconds <= 0) {
+        throw std::invalid_argument("Stress mode needs a number of iterations or a time budget.");
+    }
 
-        for (TestCase* test_case: suite->cases) {
-            s_current_case[std::this_thread::get_id()] = test_case;
+    g_stringify_limits.max_elements = args.max_elements;
+    g_stringify_limits.max_length = args.max_value_length;
 
-            bool passed = false;
-            try {
-                results.n_cases_executed++;
-                test_case->function();
-                passed = true;
+    CaseHistory history;
+    if (!args.state_file.empty()) {
+        history = load_case_history(args.state_file);
+    }
+    auto failed_as_named = [&history](const TestSuite* suite, const TestCase* test_case) {
+        auto it = history.find(case_history_key(suite->name, test_case->name,
+                                                test_case->src_file, test_case->line));
+        return it != history.end() && it->second.status != CaseStatus::PASSED;
+    };
+    auto failed_last_time = [&](const TestSuite* suite, const TestCase* test_case) {
+        if (!test_case->make_params || failed_as_named(suite, test_case)) {
+            return failed_as_named(suite, test_case);
+        }
+        // Instances aren't known yet, so look for any of them, as in "name[".
+        std::string prefix = case_history_key(suite->name, test_case->name + "[",
+                                              test_case->src_file, test_case->line);
+        return std::any_of(history.begin(), history.end(), [&prefix](const auto& entry) {
+            return entry.second.status != CaseStatus::PASSED && entry.first.compare(0, prefix.size(), prefix) == 0;
+        });
+    };
+
+    auto select_runs = [&](bool rerun_failed) {
+        std::vector<SuiteRun> runs;
+        for (TestSuite* suite: selected_suites) {
+            SuiteRun run { suite, {}, {} };
+            if (rerun_failed) {
+                // Every instance reruns if the case failed as a whole, e.g. missing its table file.
+                run.select_instance = [&failed_as_named, suite](const TestCase& instance) {
+                    return failed_as_named(suite, &instance) || failed_as_named(suite, instance.instance_of);
+                };
             }
-            catch (const TestFailure& test_failure) {
-                std::cout << "Test case '" << test_case->name << "' (assertion at line " << test_failure.line << ") failed:\n\t" << test_failure.what() << std::endl;
+            for (TestCase* test_case: suite->cases) {
+                // Benchmark runs only execute benchmarks, and test runs skip them.
+                if ((test_case->kind == CaseKind::BENCHMARK) != args.benchmarks) {
+                    continue;
+                }
+                if (!rerun_failed || failed_last_time(suite, test_case)) {
+                    run.cases.push_back(test_case);
+                }
             }
-            catch (const std::exception& e) {
-                std::cerr << "Test case '" << test_case->name << "' threw an unexpected exception:\n" << e.what() << std::endl;
-                results.n_cases_incomplete++;
+
+            // Don't bother setting up suites whose cases were all filtered out.
+            if (run.cases.empty() && (args.benchmarks || rerun_failed || !suite->cases.empty())) {
+                continue;
             }
+            runs.push_back(std::move(run));
+        }
+        return runs;
+    };
+    std::vector<SuiteRun> runs = select_runs(args.rerun_failed);
+    if (args.rerun_failed && runs.empty()) {
+        // Passing for lack of history would hide that nothing was checked.
+        std::cout << "No failed cases recorded";
+        if (!args.state_file.empty()) {
+            std::cout << " in '" << args.state_file << "'";
+        }
+        std::cout << ", running every case." << std::endl;
+        runs = select_runs(false);
+    }
 
-            if (passed) {
-                results.n_cases_passed++;
+    // Without a number of repetitions, repeating until a failure may go on forever.
+    for (int repetition = 0; args.repeat <= 0 || repetition < args.repeat; ++repetition) {
+        std::vector<SuiteRun> order = runs;
+        if (args.shuffle) {
+            shuffle_runs(order, args.seed, repetition);
+        }
+        if (args.failed_first) {
+            for (SuiteRun& run: order) {
+                std::stable_partition(run.cases.begin(), run.cases.end(), [&](const TestCase* test_case) {
+                    return failed_last_time(run.suite, test_case);
+                });
             }
+            // Failures sort first within each suite, so checking the first case suffices.
+            std::stable_partition(order.begin(), order.end(), [&](const SuiteRun& run) {
+                return !run.cases.empty() && failed_last_time(run.suite, run.cases.front());
+            });
         }
 
-        suite->cleanup();
+        int n_failed_before = state.results.n_cases_executed - state.results.n_cases_passed;
+        state.new_repetition();
+        execute_runs(state, order, args);
+        state.results.n_repetitions++;
+        int n_failed = state.results.n_cases_executed - state.results.n_cases_passed;
+        if (state.cancelled() || (args.until_fail && n_failed > n_failed_before)) {
+            break;
+        }
+    }
+
+    state.results.n_assertions = int(assertion_count() - initial_assertion_count);
+    state.results.cancelled = state.cancelled();
+    if (state.results.cancelled) {
+        int n_selected = 0;
+        for (const SuiteRun& run: runs) {
+            n_selected += int(run.cases.size());
+        }
+        state.results.n_cases_skipped = n_selected * state.results.n_repetitions - state.n_cases_started();
     }
+    state.finish();
+    state.rethrow_fatal_error();
 
-    return results;
+    if (!args.timings_file.empty()) {
+        for (const auto& [suite, seconds]: state.suite_seconds) {
+            timings[suite_timing_key(*suite)] = seconds;
+        }
+        save_suite_timings(args.timings_file, timings);
+    }
+
+    if (!args.state_file.empty()) {
+        for (const CaseReport& report: state.results.cases) {
+            std::string key = case_history_key(report.suite, report.name, report.src_file, report.line);
+            history[key] = { report.status, report.time.wall_seconds };
+        }
+        save_case_history(args.state_file, history);
+    }
+
+    if (!args.compare_baseline_file.empty()) {
+        Baseline baseline = load_baseline(args.compare_baseline_file);
+        for (CaseReport& report: state.results.cases) {
+            if (!report.benchmark) {
+                continue;
+            }
+            auto it = baseline.find(benchmark_key(report.suite, report.name));
+            if (it == baseline.end() || it->second.empty()) {
+                continue;
+            }
+            report.baseline = compare_to_baseline(*report.benchmark, it->second,
+                                                  args.regression_threshold,
+                                                  args.regression_alpha);
+            if (report.baseline->regression) {
+                state.results.n_benchmark_regressions++;
+            }
+        }
+    }
+    if (!args.save_baseline_file.empty()) {
+        save_baseline(args.save_baseline_file, state.results);
+    }
+    return state.results;
 }
 
 enum class ExecutionMode {
     NORMAL,
+    ISOLATED,
+    BENCHMARK,
     LIST_SUITES,
     UNKNOWN
 };
@@ -273,7 +1246,9 @@ ProgramArgs::ProgramArgs(int argc, char** argv) {
     if (first_arg[0] != '-') {
         // User has specified an execution mode.
         std::unordered_map<std::string, ExecutionMode> exec_modes {
-            { "suites", ExecutionMode::LIST_SUITES }
+            { "suites", ExecutionMode::LIST_SUITES },
+            { "isolated", ExecutionMode::ISOLATED },
+            { "bench", ExecutionMode::BENCHMARK }
         };
         auto it = exec_modes.find(first_arg);
         if (it == exec_modes.end()) {
@@ -332,27 +1307,268 @@ bool ProgramArgs::has_arg(const std::string& arg_name) const {
     return get_arg(arg_name).has_value();
 }
 
+/**
+ * Returns the first parameter of an argument that requires one.
+ */
+static std::string required_param(const ProgramArgs& args, const std::string& arg_name) {
+    std::optional<Argument> arg = args.get_arg(arg_name);
+    if (!arg || arg->parameters.empty()) {
+        throw std::invalid_argument("Option -" + arg_name + " requires a value.");
+    }
+    return arg->parameters[0];
+}
+
+static void print_slowest_cases(const RunTestsResults& results, int n) {
+    std::vector<const CaseReport*> cases;
+    for (const CaseReport& report: results.cases) {
+        cases.push_back(&report);
+    }
+    n = std::max(0, std::min(n, int(cases.size())));
+    std::partial_sort(cases.begin(), cases.begin() + n, cases.end(), [](auto a, auto b) {
+        return a->time.wall_seconds > b->time.wall_seconds;
+    });
+
+    std::cout << "Slowest " << n << " test cases (wall / CPU):" << std::endl;
+    std::ios_base::fmtflags flags = std::cout.flags();
+    std::cout << std::fixed << std::setprecision(3);
+    for (int i = 0; i < n; ++i) {
+        const CaseReport& report = *cases[i];
+        std::cout << "  " << report.time.wall_seconds * 1000 << " ms / "
+                  << report.time.cpu_seconds * 1000 << " ms  "
+                  << report.suite << "." << report.name
+                  << (report.over_budget ? " (over budget)" : "") << std::endl;
+    }
+    std::cout.flags(flags);
+}
+
+static void print_stress_results(const RunTestsResults& results) {
+    bool header = false;
+    std::ios_base::fmtflags flags = std::cout.flags();
+    std::cout << std::fixed << std::setprecision(1);
+    for (const CaseReport& report: results.cases) {
+        if (!report.stress) {
+            continue;
+        }
+        if (!header) {
+            std::cout << "Stressed test cases (threads x iterations, runs/s, iteration min / median / max):"
+                      << std::endl;
+            header = true;
+        }
+        const StressStats& stats = *report.stress;
+        std::cout << "  " << report.suite << "." << report.name << ": "
+                  << stats.threads << " x " << stats.iterations << ", "
+                  << stats.runs_per_second << " runs/s, "
+                  << stats.min_iteration_ns / 1000 << " / " << stats.median_iteration_ns / 1000 << " / "
+                  << stats.max_iteration_ns / 1000 << " us";
+        if (stats.n_failures) {
+            std::cout << ", " << stats.n_failures << " failure(s)";
+        }
+        std::cout << std::endl;
+    }
+    std::cout.flags(flags);
+}
+
 static int run_mode_normal(const ProgramArgs& args) {
     RunTestsArgs test_args;
+    test_args.isolated = args.exec_mode() == ExecutionMode::ISOLATED;
 
     if (args.has_arg("only")) {
         test_args.suites = args.get_arg("only")->parameters;
     }
 
+    if (args.has_arg("jobs")) {
+        // A bare '-jobs' uses every available hardware thread.
+        std::vector<std::string> params = args.get_arg("jobs")->parameters;
+        test_args.jobs = params.empty()
+            ? int(std::thread::hardware_concurrency())
+            : std::stoi(params[0]);
+    }
+
+    test_args.parallel_cases = args.has_arg("parallel-cases");
+    test_args.capture_output = !args.has_arg("no-capture");
+
+    if (args.has_arg("shard-count") != args.has_arg("shard-index")) {
+        // Running every suite on every shard would go unnoticed.
+        throw std::invalid_argument("-shard-count and -shard-index must be given together.");
+    }
+    if (args.has_arg("shard-count")) {
+        test_args.shard_count = std::stoi(required_param(args, "shard-count"));
+    }
+    if (args.has_arg("shard-index")) {
+        test_args.shard_index = std::stoi(required_param(args, "shard-index"));
+    }
+    if (args.has_arg("timings")) {
+        test_args.timings_file = required_param(args, "timings");
+    }
+    test_args.rerun_failed = args.has_arg("rerun-failed");
+    test_args.failed_first = args.has_arg("failed-first");
+    // Always kept, so that a later run can rerun what failed in this one.
+    test_args.state_file = args.has_arg("state") ? required_param(args, "state") : ".litetest-state";
+
+    if (args.has_arg("reporter")) {
+        test_args.reporter = required_param(args, "reporter");
+    }
+    if (args.has_arg("output")) {
+        test_args.report_file = required_param(args, "output");
+    }
+    if (args.has_arg("timeout")) {
+        test_args.case_timeout = std::stod(required_param(args, "timeout")) / 1000;
+    }
+    if (args.has_arg("suite-timeout")) {
+        test_args.suite_timeout = std::stod(required_param(args, "suite-timeout")) / 1000;
+    }
+    test_args.track_allocations = args.has_arg("track-allocations");
+    if (args.has_arg("seed")) {
+        test_args.seed = std::stoull(required_param(args, "seed"));
+    }
+    if (args.has_arg("property-samples")) {
+        test_args.property_samples = std::stoi(required_param(args, "property-samples"));
+    }
+    if (args.has_arg("property-threads")) {
+        test_args.property_threads = std::stoi(required_param(args, "property-threads"));
+    }
+    if (args.has_arg("stress")) {
+        test_args.stress_threads = std::stoi(required_param(args, "stress"));
+    }
+    if (args.has_arg("stress-iterations")) {
+        test_args.stress_iterations = std::stoll(required_param(args, "stress-iterations"));
+    }
+    if (args.has_arg("stress-time")) {
+        test_args.stress_seconds = std::stod(required_param(args, "stress-time")) / 1000;
+    }
+    test_args.until_fail = args.has_arg("until-fail");
+    if (args.has_arg("repeat")) {
+        test_args.repeat = std::stoi(required_param(args, "repeat"));
+    }
+    else if (test_args.until_fail) {
+        test_args.repeat = 0;
+    }
+    test_args.shuffle = args.has_arg("shuffle");
+    if (args.has_arg("max-elements")) {
+        test_args.max_elements = std::stoull(required_param(args, "max-elements"));
+    }
+    if (args.has_arg("max-value-length")) {
+        test_args.max_value_length = std::stoull(required_param(args, "max-value-length"));
+    }
+    if (args.has_arg("fail-fast")) {
+        test_args.max_failures = 1;
+    }
+    if (args.has_arg("max-failures")) {
+        test_args.max_failures = std::stoi(required_param(args, "max-failures"));
+    }
+    if (args.has_arg("time-budget")) {
+        test_args.case_time_budget = std::stod(required_param(args, "time-budget")) / 1000;
+    }
+
     RunTestsResults results = run_tests(test_args);
 
     std::cout.flush();
     std::cerr.flush();
 
     std::cout << "Testing finished." << std::endl;
-    std::cout << results.n_cases_passed << " of " << results.n_cases_executed << " passed (" << internal::g_assert_count << " total assertions made)." << std::endl;
+    std::cout << results.n_cases_passed << " of " << results.n_cases_executed << " passed (" << results.n_assertions << " total assertions made)." << std::endl;
     if (results.n_cases_incomplete) {
         std::cout << results.n_cases_incomplete << " threw an unexpected exception." << std::endl;
     }
+    if (results.n_cases_crashed) {
+        std::cout << results.n_cases_crashed << " crashed." << std::endl;
+    }
+    if (results.n_cases_timed_out) {
+        std::cout << results.n_cases_timed_out << " timed out." << std::endl;
+    }
+    if (test_args.track_allocations) {
+        std::cout << results.n_allocations << " allocations (" << results.n_bytes_allocated
+                  << " bytes) made by test cases." << std::endl;
+    }
+    if (results.n_cases_leaking) {
+        std::cout << results.n_cases_leaking << " leaked memory." << std::endl;
+    }
+    if (results.cancelled) {
+        std::cout << "Stopped after " << test_args.max_failures << " failure(s), "
+                  << results.n_cases_skipped << " test case(s) not run." << std::endl;
+    }
+    if (results.n_cases_over_budget) {
+        std::cout << results.n_cases_over_budget << " exceeded the time budget." << std::endl;
+    }
+    if (results.n_checks_skipped) {
+        std::cout << results.n_checks_skipped << " check(s) of unavailable performance counters skipped."
+                  << std::endl;
+    }
+
+    if (results.n_repetitions > 1 || test_args.until_fail) {
+        std::cout << "Ran " << results.n_repetitions << " repetition(s)." << std::endl;
+    }
+    if (test_args.shuffle) {
+        std::cout << "Order shuffled with -seed " << results.seed << "." << std::endl;
+    }
+    print_stress_results(results);
+
+    if (args.has_arg("slowest")) {
+        print_slowest_cases(results, std::stoi(required_param(args, "slowest")));
+    }
 
     return results.n_cases_executed - results.n_cases_passed;
 }
 
+static int run_mode_bench(const ProgramArgs& args) {
+    RunTestsArgs test_args;
+    test_args.benchmarks = true;
+
+    if (args.has_arg("only")) {
+        test_args.suites = args.get_arg("only")->parameters;
+    }
+    if (args.has_arg("bench-time")) {
+        test_args.benchmark_sample_time = std::stod(required_param(args, "bench-time")) / 1000;
+    }
+    if (args.has_arg("bench-samples")) {
+        test_args.benchmark_samples = std::stoi(required_param(args, "bench-samples"));
+    }
+    if (args.has_arg("save-baseline")) {
+        test_args.save_baseline_file = required_param(args, "save-baseline");
+    }
+    if (args.has_arg("compare-baseline")) {
+        test_args.compare_baseline_file = required_param(args, "compare-baseline");
+    }
+    if (args.has_arg("regression-threshold")) {
+        test_args.regression_threshold = std::stod(required_param(args, "regression-threshold")) / 100;
+    }
+
+    RunTestsResults results = run_tests(test_args);
+
+    std::cout.flush();
+    std::cerr.flush();
+
+    std::ios_base::fmtflags flags = std::cout.flags();
+    std::cout << std::fixed << std::setprecision(2);
+    for (const CaseReport& report: results.cases) {
+        if (!report.benchmark) {
+            continue;
+        }
+        const BenchmarkStats& stats = *report.benchmark;
+        std::cout << report.suite << "." << report.name << ":\n"
+                  << "\tmin " << stats.min_ns << " ns, median " << stats.median_ns
+                  << " ns, mean " << stats.mean_ns << " ns (stddev " << stats.stddev_ns << " ns)\n"
+                  << "\t" << stats.ops_per_second << " ops/s ("
+                  << stats.sample_ns.size() << " samples of " << stats.iterations << " iterations)" << std::endl;
+        if (report.baseline) {
+            const BaselineComparison& comparison = *report.baseline;
+            std::cout << "\t" << std::showpos << comparison.change * 100 << std::noshowpos
+                      << "% vs. baseline median of " << comparison.baseline_median_ns
+                      << " ns (p = " << std::setprecision(4) << comparison.p_value << std::setprecision(2) << ")"
+                      << (comparison.regression ? " REGRESSION" : "") << std::endl;
+        }
+    }
+    std::cout.flags(flags);
+
+    std::cout << "Benchmarking finished." << std::endl;
+    std::cout << results.n_cases_passed << " of " << results.n_cases_executed << " benchmarks completed." << std::endl;
+    if (results.n_benchmark_regressions) {
+        std::cout << results.n_benchmark_regressions << " regressed compared to the baseline." << std::endl;
+    }
+
+    return results.n_cases_executed - results.n_cases_passed + results.n_benchmark_regressions;
+}
+
 static int run_mode_list_suites(const ProgramArgs& args) {
     auto suites = process_suites();
     for (const TestSuite* suite: suites) {
@@ -361,18 +1577,73 @@ static int run_mode_list_suites(const ProgramArgs& args) {
     return 0;
 }
 
+static int run_mode(const ProgramArgs& args) {
+    switch (args.exec_mode()) {
+        case ExecutionMode::LIST_SUITES:
+            return run_mode_list_suites(args);
+        case ExecutionMode::NORMAL:
+        case ExecutionMode::ISOLATED:
+            return run_mode_normal(args);
+        case ExecutionMode::BENCHMARK:
+            return run_mode_bench(args);
+        default:
+            throw std::invalid_argument("Unknown execution mode.");
+    }
+}
+
+/**
+ * Reloads the modules each time they change, running again after each
+ * reload. Only returns by throwing.
+ */
+/**
+ * Runs the mode selected by 'args', reporting rather than throwing
+ * errors, e.g. a case without a suite in a broken build, which the next
+ * build may fix.
+ */
+static void run_mode_watched(const ProgramArgs& args) {
+    try {
+        run_mode(args);
+    }
+    catch (const std::exception& err) {
+        std::cerr << "Run failed:\n" << err.what() << std::endl;
+    }
+}
+
+[[noreturn]] static void watch_modules(const ProgramArgs& args) {
+    run_mode_watched(args);
+    while (true) {
+        std::cout << "Watching modules for changes..." << std::endl;
+        wait_for_module_changes();
+        try {
+            reload_modules();
+        }
+        catch (const std::runtime_error& err) {
+            // Likely a broken build, which the next one may fix.
+            std::cerr << err.what() << std::endl;
+            continue;
+        }
+        run_mode_watched(args);
+    }
+}
+
 int litetest_main(int argc, char* argv[]) {
     ProgramArgs args(argc, argv);
 
     try {
-        switch (args.exec_mode()) {
-            case ExecutionMode::LIST_SUITES:
-                return run_mode_list_suites(args);
-            case ExecutionMode::NORMAL:
-                return run_mode_normal(args);
-            default:
-                throw std::invalid_argument("Unknown execution mode.");
+        if (args.has_arg("modules")) {
+            std::vector<std::string> paths = args.get_arg("modules")->parameters;
+            for (const std::string& path: paths) {
+                load_module(path);
+            }
+        }
+        if (args.has_arg("watch") && !args.has_arg("modules")) {
+            throw std::invalid_argument("--watch requires -modules.");
+        }
+
+        if (args.has_arg("watch")) {
+            watch_modules(args);
         }
+        return run_mode(args);
     }
     catch (const std::exception& err) {
         std::cerr << "Fatal:\n" << err.what() << std::endl;
@@ -1,89 +1,100 @@
 #ifndef LITETEST_H
 #define LITETEST_H
 
+// The usual include of test files. Features pulling in heavier headers are
+// included on their own by the files using them: params.h for PARAM_CASE()
+// and TABLE_CASE(), property.h for PROPERTY_CASE(), async.h for
+// TEST_CASE_ASYNC(), bulk.h for EXPECT_RANGE(), perf.h for EXPECT_PERF()
+// and benchmark.h for BENCHMARK_CASE().
+
+#include "core.h"
 #include "internal.h"
 #include "stringify.h"
 
 namespace litetest {
 
 /**
- * Defines a test suite.
- * A test suite consists in a named group of test cases.
- * Each test suite may contain a setup or a cleanup procedure, defined
- * respectively by SUITE_SETUP() and SUITE_CLEANUP(). These procedures are
- * guaranteed to be invoked before and after all test cases from the suite
- * are executed.
+ * Fails the current test case unless the number of heap allocations
+ * 'fn' makes through operator new on the calling thread passes the test.
  *
- * Usage: TEST_SUITE(your_suite_name);
+ * Usage examples:
+ *      EXPECT_ALLOCS([&]() { cache.lookup(key); }).to_be(0);
+ *      EXPECT_ALLOCS([&]() { parse(text); }).to_be_less_than(4);
  */
-#define TEST_SUITE(name) \
-    static auto s_suite##name = []() { \
-        return litetest::internal::push_suite(#name, __FILE__, __LINE__); \
-    }()
+#define EXPECT_ALLOCS(fn) (::litetest::internal::ExpectValue<int64_t>(::litetest::count_allocations(fn), __LINE__))
 
 /**
- * Defines a test case.
- * A test case must be preceded by a declaration of a test suite.
- *
- * Usage: TEST_CASE(your_case_name) {
- *      // Your test case code here...
- * }
+ * Returns the number of heap allocations 'fn' makes through operator new
+ * on the calling thread. Throws std::logic_error unless the program links
+ * the litetest_allocs library, which counts them.
  */
-#define TEST_CASE(name) \
-    static void case_##name(); \
-    static auto s_case_##name = []() { \
-        return litetest::internal::push_case(#name, case_##name, __FILE__, __LINE__); \
-    }(); \
-    static void case_##name()
+template <typename F>
+int64_t count_allocations(F&& fn) {
+    if (!internal::g_allocation_hooks) {
+        throw std::logic_error("Counting allocations requires linking the litetest_allocs library.");
+    }
+    int64_t initial_count = internal::t_allocations.count;
+    fn();
+    return internal::t_allocations.count - initial_count;
+}
 
 /**
- * Defines setup code for a test suite.
- * The test suite setup code is guaranteed to be executed before
- * the suite's test cases are run.
- * Perform any initialization code required to run the tests here.
+ * Wraps a callable so that it runs in the context of the current test case,
+ * even when invoked from another thread. Its assertions are then attributed
+ * to the case, and a failed assertion fails the case once it finishes
+ * rather than terminating the program.
+ * Threads running the callable must finish before the case does.
  *
- * Usage: SUITE_SETUP(your_suite_name) {
- *      // Your setup code here...
- * }
+ * Usage: std::thread helper(litetest::in_current_case([&]() {
+ *      EXPECT(queue.pop()).to_be(42);
+ * }));
  */
-#define SUITE_SETUP(suite_name) \
-    static void setup_##suite_name(); \
-    static auto s_suite_setup_##suite_name = []() { \
-        return litetest::internal::push_suite_setup(#suite_name, __FILE__, setup_##suite_name);  \
-    }();                                            \
-    static void setup_##suite_name()
+template <typename F>
+auto in_current_case(F fn) {
+    internal::ExecutionContext* context = internal::t_context;
+    return [context, fn = std::move(fn)](auto&&... args) mutable {
+        internal::ContextScope scope(context);
+        int64_t initial_assertion_count = internal::t_assertions.count;
+        try {
+            fn(std::forward<decltype(args)>(args)...);
+        }
+        catch (const internal::TestFailure&) {
+            if (!context) {
+                throw;
+            }
+            context->report_helper_failure(std::current_exception());
+        }
+        if (context) {
+            context->helper_assertions += internal::t_assertions.count - initial_assertion_count;
+        }
+    };
+}
 
 /**
- * Defines setup cleanup for a test suite.
- * The test suite cleanup code is guaranteed to be executed after
- * the suite's test cases are run.
- * Perform any resource cleanup required to run after the
- * suite's tests - independently of whether they fail, succeed or throw - here.
+ * Fixture of type T of the current test case's suite, e.g. a preloaded
+ * dataset. It is default-constructed the first time a case of the suite asks
+ * for it, so fixtures no selected case uses are never built, and destroyed
+ * right after the suite's cleanup. Cases run concurrently get one instance
+ * per worker, shared by the cases that worker runs, so fixtures are only
+ * to be read by cases. Building it counts towards the case's time.
  *
- * Usage: SUITE_CLEANUP(your_suite_name) {
- *      // Your setup code here...
+ * Usage: TEST_CASE(lookup) {
+ *      const Dataset& dataset = litetest::suite_fixture<Dataset>();
+ *      EXPECT(dataset.find("key")).to_be(42);
  * }
  */
-#define SUITE_CLEANUP(suite_name) \
-    static void cleanup_##suite_name(); \
-    static auto s_suite_cleanup_##suite_name = []() {                     \
-        return litetest::internal::push_suite_cleanup(#suite_name, __FILE__, cleanup_##suite_name);  \
-    }(); \
-    static void cleanup_##suite_name() \
-
+template <typename T>
+const T& suite_fixture() {
+    internal::SuiteFixtures::Factory make = []() -> std::shared_ptr<void> { return std::make_shared<T>(); };
+    return *static_cast<const T*>(internal::suite_fixture(typeid(T), make));
+}
 
 /**
- * Main macro for testing. Receives a value to be tested against other values
- * or by itself. Fails the current test case by throwing TestFailure if the requested
- * test fails.
- *
- * Usage examples:
- *      EXPECT(foo()).to_be("some expected string");
- *      EXPECT(sum(5,2)).to_be(7);
- *      EXPECT(cost_of("something")).to_be_greater_than(200);
- *
+ * True once the run the current test case belongs to was cancelled, e.g.
+ * because of RunTestsArgs::max_failures. Long cases may check it to stop
+ * early. Also works from helper threads run through in_current_case().
  */
-#define EXPECT(value) (::litetest::internal::ExpectValue(value, __LINE__))
+bool cancellation_requested();
 
 /**
  * Test arguments to be passed to run_tests().
@@ -94,6 +105,374 @@ struct RunTestsArgs {
      * If none is specified, assumes all test suites must be executed.
      */
     std::vector<std::string> suites;
+
+    /**
+     * Number of worker threads used to execute test suites.
+     * Each suite's setup, cases and cleanup are still run in that order,
+     * but different suites may run concurrently. Values lower than 2
+     * execute everything serially on the calling thread.
+     */
+    int jobs = 1;
+
+    /**
+     * If true (and jobs > 1), cases from a same suite may also run
+     * concurrently with each other, in between the suite's setup and cleanup.
+     */
+    bool parallel_cases = false;
+
+    /**
+     * If true, suites are executed by 'jobs' forked worker processes
+     * instead of threads. A case that crashes its worker (e.g. by a
+     * segfault or abort()) is reported as crashed and the worker is
+     * replaced, so the remaining cases still run.
+     * Only supported on POSIX systems.
+     */
+    bool isolated = false;
+
+    /**
+     * Splits the selected suites into 'shard_count' shards of roughly equal
+     * expected duration and only executes the one at 'shard_index'.
+     * Expected durations are read from 'timings_file'. Without timings,
+     * suites are split deterministically by a hash of their location.
+     * run_tests() throws std::invalid_argument if 'shard_index' isn't
+     * within [0, shard_count).
+     */
+    int shard_index = 0;
+    int shard_count = 1;
+
+    /**
+     * If set, the file expected suite durations are read from before the
+     * run and written to after it. Suites not executed by the run keep
+     * their previous timings.
+     */
+    std::string timings_file;
+
+    /**
+     * If set, the file the last outcome and duration of each case is read
+     * from before the run and written to after it. Cases not executed by
+     * the run keep their previous state.
+     */
+    std::string state_file;
+
+    /**
+     * If true, only cases that did not pass the last time they ran, according
+     * to 'state_file', are executed. Suites left without cases are skipped,
+     * setup and cleanup included. If no selected case is recorded as failed,
+     * every case is executed instead, saying so.
+     */
+    bool rerun_failed = false;
+
+    /**
+     * If true, suites with cases that did not pass the last time they ran,
+     * according to 'state_file', are executed first, those cases first.
+     */
+    bool failed_first = false;
+
+    /**
+     * If greater than zero, cases whose wall-clock time exceeds this many
+     * seconds are reported and flagged as over budget. They still pass.
+     */
+    double case_time_budget = 0;
+
+    /**
+     * If set, a report is written as cases finish, in the given format:
+     * 'junit' for JUnit XML, or 'jsonl' for one JSON object per line.
+     */
+    std::string reporter;
+
+    /** File the report is written to. Defaults to litetest-report.xml/.jsonl. */
+    std::string report_file;
+
+    /**
+     * If true, what cases write to stdout and stderr is captured and only
+     * shown, and attached to reports, for cases that do not pass.
+     * Serial runs and isolated workers redirect the process' file
+     * descriptors, catching output written by any means. When cases run
+     * concurrently on threads (jobs > 1 without isolation), only what they
+     * write through std::cout, std::cerr and std::clog is told apart and
+     * captured, per case; output of printf() and the like isn't.
+     */
+    bool capture_output = true;
+
+    /**
+     * If greater than zero, cases taking longer than this many seconds are
+     * reported as timed out. Cases declared with TEST_CASE_TIMEOUT() use
+     * their own limit instead. As a hung case can't be interrupted, the run
+     * is then abandoned: the report is completed and the process exits.
+     * Isolated runs instead kill the worker and carry on with a new one.
+     */
+    double case_timeout = 0;
+
+    /**
+     * If greater than zero, limits the time taken by each suite, setup and
+     * cleanup included, in seconds. Exceeding it is handled as for case_timeout,
+     * except that isolated runs don't resume the suite.
+     */
+    double suite_timeout = 0;
+
+    /**
+     * If greater than zero, the run is cancelled once this many cases did not
+     * pass: queued suites and cases are dropped, running cases may notice
+     * through cancellation_requested(), and the cleanup of every suite whose
+     * setup ran still runs.
+     */
+    int max_failures = 0;
+
+    /**
+     * If true, the heap allocations of each case are reported: their number,
+     * their total size, the peak of memory they held at once, and what they
+     * still held once the case passed, i.e. its leaks. Only allocations made
+     * through operator new by the thread running the case are counted.
+     * Requires linking the litetest_allocs library.
+     */
+    bool track_allocations = false;
+
+    /**
+     * Seed of the random inputs of PROPERTY_CASE()s, and of the order of
+     * shuffled runs. If 0, a random seed is picked and reported in
+     * RunTestsResults::seed and property failures.
+     */
+    uint64_t seed = 0;
+
+    /** Number of random inputs each PROPERTY_CASE() is checked on. */
+    int property_samples = 100;
+
+    /**
+     * Number of threads checking the inputs of a PROPERTY_CASE(), or 0 to
+     * share the hardware threads with the other jobs of the run, i.e. use
+     * hardware threads / jobs of them. Threads are only started for inputs
+     * past the first 64, so small sample counts stay on the case's thread.
+     */
+    int property_threads = 0;
+
+    /**
+     * If greater than zero, test cases run in stress mode: each iteration
+     * releases this many threads at once from a barrier, each of them running
+     * the case. Cases declared with TEST_CASE_STRESS() use their own settings.
+     * Asynchronous cases are never stressed.
+     */
+    int stress_threads = 0;
+
+    /**
+     * Stress mode stops after this many iterations, or once 'stress_seconds'
+     * have elapsed, whichever comes first. 0 disables either limit. An
+     * iteration in which any thread fails is the last.
+     */
+    int64_t stress_iterations = 100;
+    double stress_seconds = 0;
+
+    /**
+     * Number of times the selected cases are run. With 'until_fail', 0
+     * repeats them until a case fails.
+     */
+    int repeat = 1;
+
+    /** If true, repetitions stop after the first one in which a case did not pass. */
+    bool until_fail = false;
+
+    /**
+     * If true, suites, and cases within each suite, run in a random order
+     * derived from 'seed', which differs between repetitions.
+     */
+    bool shuffle = false;
+
+    /**
+     * Bounds of the values described in failure messages: elements shown of
+     * each range, the others being counted, and characters of each value,
+     * past which it's cut. 0 disables a bound.
+     */
+    size_t max_elements = 32;
+    size_t max_value_length = 4096;
+
+    /**
+     * If true, only benchmark cases are executed. Otherwise,
+     * benchmark cases are skipped.
+     */
+    bool benchmarks = false;
+
+    /** Minimum duration of each benchmark sample, in seconds. */
+    double benchmark_sample_time = 0.01;
+
+    /** Number of samples measured for each benchmark. */
+    int benchmark_samples = 10;
+
+    /** If set, benchmark samples are saved to this JSON file after the run. */
+    std::string save_baseline_file;
+
+    /**
+     * If set, benchmarks are compared against the samples stored in this
+     * JSON file, as written through save_baseline_file.
+     */
+    std::string compare_baseline_file;
+
+    /**
+     * Relative slowdown of a benchmark's median, compared to the baseline,
+     * above which it may be considered a regression.
+     */
+    double regression_threshold = 0.05;
+
+    /**
+     * A slowdown over the threshold is only considered a regression if a
+     * Mann-Whitney U test on the samples yields a p-value below this.
+     */
+    double regression_alpha = 0.05;
+};
+
+/**
+ * Time spent on some part of a test run.
+ */
+struct Timing {
+    /** Elapsed wall-clock time, in seconds. */
+    double wall_seconds = 0;
+
+    /** CPU time consumed by the thread doing the work, in seconds. */
+    double cpu_seconds = 0;
+};
+
+enum class CaseStatus {
+    PASSED,
+    FAILED,
+    INCOMPLETE,
+    CRASHED,
+    TIMED_OUT
+};
+
+/**
+ * Measurements of a benchmark case.
+ */
+struct BenchmarkStats {
+    /** Iterations of the benchmark per sample. */
+    int64_t iterations = 0;
+
+    /** Per-iteration time of each sample, in nanoseconds. */
+    std::vector<double> sample_ns;
+
+    /** Per-iteration time statistics over all samples, in nanoseconds. */
+    double min_ns = 0;
+    double median_ns = 0;
+    double mean_ns = 0;
+    double stddev_ns = 0;
+
+    /** Iterations per second, according to the mean. */
+    double ops_per_second = 0;
+};
+
+/**
+ * Heap allocations made by a test case, if tracked.
+ */
+struct AllocationStats {
+    int64_t allocations = 0;
+
+    /** Total size of the allocations. */
+    int64_t bytes = 0;
+
+    /** Most bytes held by the case's allocations at any one time. */
+    int64_t peak_bytes = 0;
+
+    /**
+     * Bytes allocated by the case and not freed by the time it finished.
+     * Only measured for passed cases: failed ones may abandon memory on
+     * their way out.
+     */
+    int64_t leaked_bytes = 0;
+};
+
+/**
+ * Measurements of a test case run in stress mode.
+ */
+struct StressStats {
+    /** Threads running the case at once. */
+    int threads = 0;
+
+    /** Iterations completed, each running the case once on every thread. */
+    int64_t iterations = 0;
+
+    /** Total time taken by the iterations, in seconds. */
+    double seconds = 0;
+
+    /** Completed runs of the case per second, across threads. */
+    double runs_per_second = 0;
+
+    /** Time from releasing the threads until the last one finished, in nanoseconds. */
+    double min_iteration_ns = 0;
+    double median_iteration_ns = 0;
+    double max_iteration_ns = 0;
+
+    /** Runs of the case that failed, across threads. */
+    int n_failures = 0;
+};
+
+/**
+ * Comparison of a benchmark against its baseline.
+ */
+struct BaselineComparison {
+    double baseline_median_ns = 0;
+
+    /** Relative change of the median, e.g. 0.1 if 10% slower. */
+    double change = 0;
+
+    /** Mann-Whitney U test p-value of the current and baseline samples. */
+    double p_value = 1;
+
+    /** True if the benchmark got significantly slower than the threshold. */
+    bool regression = false;
+};
+
+/**
+ * Outcome and timing of an executed test case.
+ */
+struct CaseReport {
+    std::string suite;
+    std::string name;
+    std::string src_file;
+    int line = 0;
+    CaseStatus status = CaseStatus::PASSED;
+    Timing time;
+
+    /** Assertions made by the case on the thread running it. */
+    int n_assertions = 0;
+
+    /**
+     * Checks the case skipped, e.g. EXPECT_PERF() tests of hardware
+     * counters the system doesn't provide.
+     */
+    int n_checks_skipped = 0;
+
+    /** Failure, exception or crash description. Empty for passed cases. */
+    std::string message;
+
+    /** Line of the failed assertion, if the case failed. */
+    int failure_line = 0;
+
+    /** True if the case took longer than RunTestsArgs::case_time_budget. */
+    bool over_budget = false;
+
+    /** Measurements, if the case is a benchmark that completed. */
+    std::optional<BenchmarkStats> benchmark;
+
+    /** Heap allocations of the case, if tracked. */
+    std::optional<AllocationStats> allocations;
+
+    /** Measurements, if the case ran in stress mode. */
+    std::optional<StressStats> stress;
+
+    /** Comparison against the baseline, if requested and the benchmark has one. */
+    std::optional<BaselineComparison> baseline;
+
+    /** Output captured while the case ran, if it did not pass. */
+    std::string captured_stdout;
+    std::string captured_stderr;
+};
+
+/**
+ * Timing of an executed suite's setup and cleanup.
+ */
+struct SuiteReport {
+    std::string name;
+    std::string src_file;
+    int line = 0;
+    Timing setup;
+    Timing cleanup;
 };
 
 struct RunTestsResults {
@@ -106,6 +485,52 @@ struct RunTestsResults {
 
     /** Number of test cases that threw an exception that wasn't TestFailure. */
     int n_cases_incomplete = 0;
+
+    /** Number of test cases that crashed their worker process (isolated runs only). */
+    int n_cases_crashed = 0;
+
+    /** Number of test cases that exceeded their time limit, or their suite's. */
+    int n_cases_timed_out = 0;
+
+    /** Number of assertions made during the run. */
+    int n_assertions = 0;
+
+    /** True if the run was cancelled before executing every selected case. */
+    bool cancelled = false;
+
+    /**
+     * Number of selected cases left unexecuted because the run was cancelled.
+     * A parameterized case counts as one, unless any of its instances ran.
+     */
+    int n_cases_skipped = 0;
+
+    /** Number of test cases whose wall-clock time exceeded the time budget. */
+    int n_cases_over_budget = 0;
+
+    /** Checks skipped by test cases, see CaseReport::n_checks_skipped. */
+    int n_checks_skipped = 0;
+
+    /** Heap allocations made by test cases, and their size, if tracked. */
+    int64_t n_allocations = 0;
+    int64_t n_bytes_allocated = 0;
+
+    /** Number of test cases that leaked memory, if allocations are tracked. */
+    int n_cases_leaking = 0;
+
+    /** Seed of the random inputs of property cases, and of the order of shuffled runs. */
+    uint64_t seed = 0;
+
+    /** Number of times the selected cases were run. */
+    int n_repetitions = 0;
+
+    /** Number of benchmarks that regressed compared to the baseline. */
+    int n_benchmark_regressions = 0;
+
+    /** Every executed case, in the order they finished. */
+    std::vector<CaseReport> cases;
+
+    /** Every executed suite, in the order their setup finished. */
+    std::vector<SuiteReport> suites;
 };
 
 /**
@@ -113,6 +538,21 @@ struct RunTestsResults {
  */
 RunTestsResults run_tests(RunTestsArgs args = {});
 
+/**
+ * Loads a test module: a shared library of test files built without linking
+ * litetest (see litetest_add_module() in CMake), into a program exporting
+ * litetest's symbols such as litetest_runner. Its suites then run along with
+ * the program's. Throws std::runtime_error if it can't be loaded, and
+ * std::invalid_argument if it already is. Only supported on POSIX systems.
+ */
+void load_module(const std::string& path);
+
+/**
+ * Unloads every loaded module, then loads them again from their files, e.g.
+ * once rebuilt. Must not be called while tests are running.
+ */
+void reload_modules();
+
 /**
  * If desired, litetest_main automatically performs all tests and logs results to stdout.
  * Returns the number of failed + incomplete cases.
@@ -0,0 +1,223 @@
+#include "litetest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LITETEST_HAS_DLOPEN 1
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace litetest {
+
+namespace internal {
+
+#ifdef LITETEST_HAS_DLOPEN
+
+namespace {
+
+struct Module {
+    std::string path;
+    void* handle = nullptr;
+
+    /** Registrations made by the module's static initializers. */
+    Registry registry;
+
+    /** Modification time of the file when it was loaded, in nanoseconds. */
+    int64_t mtime = -1;
+};
+
+// Modules are only loaded and unloaded in between runs. They're held by
+// pointer so that their registries keep their address.
+std::vector<std::unique_ptr<Module>> s_modules;
+
+/** In nanoseconds, or -1 if the file doesn't exist. */
+int64_t modification_time(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return -1;
+    }
+#ifdef __APPLE__
+    return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+/** Copies 'path' to a new temporary file, returning the copy's path. */
+std::string copy_to_temporary(const std::string& path) {
+    const char* tmp_dir = std::getenv("TMPDIR");
+    std::string copy = std::string(tmp_dir && *tmp_dir ? tmp_dir : "/tmp") + "/litetest-module-XXXXXX";
+    int out = mkstemp(copy.data());
+    int in = out < 0 ? -1 : open(path.c_str(), O_RDONLY);
+    bool copied = in >= 0;
+    char buffer[65536];
+    ssize_t n_read;
+    while (copied && (n_read = read(in, buffer, sizeof(buffer))) != 0) {
+        copied = n_read > 0 && write(out, buffer, size_t(n_read)) == n_read;
+    }
+    std::string error = std::strerror(errno);
+    if (in >= 0) {
+        close(in);
+    }
+    if (out >= 0) {
+        close(out);
+        if (!copied) {
+            unlink(copy.c_str());
+        }
+    }
+    if (!copied) {
+        throw std::runtime_error("Cannot copy module " + path + ": " + error);
+    }
+    return copy;
+}
+
+/** dlopen()s 'file', collecting the registrations of its static initializers into the module's registry. */
+void open_module(Module& module, const std::string& file) {
+    module.registry = Registry();
+    Registry* previous = set_registry(&module.registry);
+    void* handle = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+    set_registry(previous);
+    if (!handle) {
+        throw std::runtime_error("Cannot load module " + module.path + ": " + dlerror());
+    }
+    module.handle = handle;
+}
+
+void load(Module& module) {
+    module.mtime = modification_time(module.path);
+
+    // A copy is opened rather than the file itself, which builds may then
+    // rewrite in place without breaking the mapped module. The loader also
+    // identifies modules by file, so opening the file again could return
+    // the previous module, if kept resident (e.g. for defining STB_GNU_UNIQUE
+    // symbols), without running its initializers. Once mapped, the copy can
+    // be deleted.
+    std::string copy = copy_to_temporary(module.path);
+    try {
+        open_module(module, copy);
+    }
+    catch (...) {
+        unlink(copy.c_str());
+        throw;
+    }
+    unlink(copy.c_str());
+}
+
+void unload(Module& module) {
+    module.registry = Registry();
+    if (module.handle) {
+        dlclose(module.handle);
+        module.handle = nullptr;
+    }
+}
+
+bool modules_changed() {
+    for (const auto& module: s_modules) {
+        if (modification_time(module->path) != module->mtime) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+std::vector<const Registry*> module_registries() {
+    std::vector<const Registry*> registries;
+    for (const auto& module: s_modules) {
+        registries.push_back(&module->registry);
+    }
+    return registries;
+}
+
+void wait_for_module_changes() {
+    constexpr auto POLL_INTERVAL = std::chrono::milliseconds(200);
+    if (s_modules.empty()) {
+        throw std::logic_error("No module is loaded.");
+    }
+    while (!modules_changed()) {
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+
+    // Until every file exists and kept its modification time for an interval.
+    std::vector<int64_t> mtimes;
+    while (true) {
+        std::vector<int64_t> current;
+        for (const auto& module: s_modules) {
+            current.push_back(modification_time(module->path));
+        }
+        bool missing = std::find(current.begin(), current.end(), -1) != current.end();
+        if (!missing && current == mtimes) {
+            return;
+        }
+        mtimes = std::move(current);
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+}
+
+#else
+
+std::vector<const Registry*> module_registries() {
+    return {};
+}
+
+void wait_for_module_changes() {
+    throw std::runtime_error("Test modules are only supported on POSIX systems.");
+}
+
+#endif // LITETEST_HAS_DLOPEN
+
+} // internal
+
+using namespace internal;
+
+#ifdef LITETEST_HAS_DLOPEN
+
+void load_module(const std::string& path) {
+    for (const auto& module: s_modules) {
+        if (module->path == path) {
+            throw std::invalid_argument("Module " + path + " is already loaded.");
+        }
+    }
+    auto module = std::make_unique<Module>();
+    module->path = path;
+    load(*module);
+    discard_suites();
+    s_modules.push_back(std::move(module));
+}
+
+void reload_modules() {
+    // Suites refer to the code of the modules, so they go first.
+    discard_suites();
+    for (auto it = s_modules.rbegin(); it != s_modules.rend(); ++it) {
+        unload(**it);
+    }
+    for (const auto& module: s_modules) {
+        load(*module);
+    }
+}
+
+#else
+
+void load_module(const std::string& path) {
+    throw std::runtime_error("Test modules are only supported on POSIX systems.");
+}
+
+void reload_modules() {}
+
+#endif // LITETEST_HAS_DLOPEN
+
+} // litetest
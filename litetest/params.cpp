@@ -0,0 +1,137 @@
+#include "params.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LITETEST_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace litetest {
+
+const std::vector<std::string_view>& TableRow::fields() const {
+    if (m_split) {
+        return m_fields;
+    }
+    char separator = m_text.find('\t') != std::string_view::npos ? '\t' : ',';
+    size_t start = 0;
+    while (true) {
+        size_t end = m_text.find(separator, start);
+        if (end == std::string_view::npos) {
+            m_fields.push_back(m_text.substr(start));
+            break;
+        }
+        m_fields.push_back(m_text.substr(start, end - start));
+        start = end + 1;
+    }
+    m_split = true;
+    return m_fields;
+}
+
+namespace internal {
+
+#ifdef LITETEST_HAS_MMAP
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open table file '" + path + "': " + std::strerror(errno));
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to read table file '" + path + "': " + std::strerror(errno));
+    }
+    m_size = size_t(info.st_size);
+    if (m_size > 0) {
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Failed to map table file '" + path + "': " + std::strerror(errno));
+        }
+        // Rows are mostly visited in order.
+        madvise(data, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(data);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open table file '" + path + "'.");
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    m_fallback = contents.str();
+    m_data = m_fallback.data();
+    m_size = m_fallback.size();
+}
+
+MappedFile::~MappedFile() = default;
+
+#endif // LITETEST_HAS_MMAP
+
+TableParams::TableParams(const std::string& path, void (*function)(const TableRow&))
+    : m_file(path), m_function(function) {}
+
+bool TableParams::next_row(std::string_view& text, uint64_t& line_number) {
+    std::string_view contents = m_file.contents();
+    const char* end = contents.data() + contents.size();
+    while (m_position < contents.size()) {
+        const char* line = contents.data() + m_position;
+        auto newline = static_cast<const char*>(std::memchr(line, '\n', size_t(end - line)));
+        const char* line_end = newline ? newline : end;
+        m_position = size_t(line_end - contents.data()) + (newline ? 1 : 0);
+        m_line_number++;
+
+        size_t length = size_t(line_end - line);
+        if (length > 0 && line[length - 1] == '\r') {
+            length--;
+        }
+        if (length > 0 && line[0] != '#') {
+            text = std::string_view(line, length);
+            line_number = m_line_number;
+            m_next_row++;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<CaseInput> TableParams::input(size_t i) {
+    if (i < m_next_row) {
+        m_position = 0;
+        m_next_row = 0;
+        m_line_number = 0;
+    }
+    std::string_view text;
+    uint64_t line_number = 0;
+    do {
+        if (!next_row(text, line_number)) {
+            return std::nullopt;
+        }
+    } while (m_next_row <= i);
+    return CaseInput { "line " + std::to_string(line_number), [this, text, line_number]() {
+        m_function(TableRow(text, line_number));
+    } };
+}
+
+} // internal
+
+} // litetest
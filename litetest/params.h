@@ -0,0 +1,192 @@
+#ifndef LITETEST_PARAMS_H
+#define LITETEST_PARAMS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "internal.h"
+
+namespace litetest {
+
+/**
+ * Inputs of a PARAM_CASE(), e.g. values(1, 2, 3) or values<std::string>("a", "b").
+ */
+template <typename T = void, typename... Args>
+auto values(Args&&... args) {
+    using Value = std::conditional_t<std::is_void_v<T>, std::common_type_t<std::decay_t<Args>...>, T>;
+    return std::vector<Value> { Value(std::forward<Args>(args))... };
+}
+
+/**
+ * Inputs of a PARAM_CASE() going from 'first' to 'last', excluded, by 'step'.
+ * Throws std::invalid_argument if 'step' is 0.
+ */
+template <typename T>
+std::vector<T> range(T first, T last, T step = T(1)) {
+    if (step == T(0)) {
+        throw std::invalid_argument("range() requires a non-zero step.");
+    }
+    std::vector<T> inputs;
+    for (T value = first; step > 0 ? value < last : value > last; value += step) {
+        inputs.push_back(value);
+    }
+    return inputs;
+}
+
+/**
+ * A line of a TABLE_CASE()'s file. Its fields, separated by tabs if the line
+ * has any or by commas otherwise, are only split on first access.
+ * Refers to the mapped file, so it must not be kept past the case.
+ */
+class TableRow {
+public:
+    TableRow(std::string_view text, uint64_t line_number)
+        : m_text(text), m_line_number(line_number) {}
+
+    /** Whole line, without its line break. */
+    std::string_view text() const { return m_text; }
+
+    /** 1-based line number of the row in its file. */
+    uint64_t line_number() const { return m_line_number; }
+
+    size_t size() const { return fields().size(); }
+
+    /** Field 'i', or an empty string if the row doesn't have that many. */
+    std::string_view operator[](size_t i) const {
+        const std::vector<std::string_view>& all = fields();
+        return i < all.size() ? all[i] : std::string_view();
+    }
+
+private:
+    const std::vector<std::string_view>& fields() const;
+
+    std::string_view m_text;
+    uint64_t m_line_number;
+    mutable std::vector<std::string_view> m_fields;
+    mutable bool m_split = false;
+};
+
+namespace internal {
+
+/**
+ * Inputs of a PARAM_CASE(), enumerated up front.
+ */
+template <typename T>
+class GeneratedParams : public CaseParams {
+public:
+    GeneratedParams(std::vector<T> inputs, void (*function)(const T&))
+        : m_inputs(std::move(inputs)), m_function(function) {}
+
+    /** Labeled with its index. */
+    std::optional<CaseInput> input(size_t i) override {
+        if (i >= m_inputs.size()) {
+            return std::nullopt;
+        }
+        return CaseInput { std::to_string(i), [this, i]() { m_function(m_inputs[i]); } };
+    }
+
+private:
+    std::vector<T> m_inputs;
+    void (*m_function)(const T&);
+};
+
+/**
+ * Read-only view of a whole file, mapped into memory where supported.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view contents() const { return { m_data, m_size }; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    // Holds the contents where files can't be mapped.
+    std::string m_fallback;
+};
+
+/**
+ * Rows of a TABLE_CASE()'s file. The file is only mapped up front: rows are
+ * located by scanning forward as they're asked for, without remembering the
+ * ones passed, and split into fields when their instance runs. Asking for an
+ * earlier row scans again from the start. Blank lines and lines starting
+ * with '#' are skipped.
+ */
+class TableParams : public CaseParams {
+public:
+    /** Throws std::runtime_error if the file can't be read. */
+    TableParams(const std::string& path, void (*function)(const TableRow&));
+
+    /** Labeled with its line number. */
+    std::optional<CaseInput> input(size_t i) override;
+
+private:
+    /** Locates the next row into 'text' and 'line_number', false past the last. */
+    bool next_row(std::string_view& text, uint64_t& line_number);
+
+    MappedFile m_file;
+
+    /** Where the next row is searched from, its index, and the line before it. */
+    size_t m_position = 0;
+    size_t m_next_row = 0;
+    uint64_t m_line_number = 0;
+
+    void (*m_function)(const TableRow&);
+};
+
+} // internal
+
+/**
+ * Defines a parameterized test case, run once per input. 'inputs' is
+ * anything convertible to a std::vector<type>, e.g. litetest::values() or
+ * litetest::range(). It is only evaluated when the case starts running.
+ * Each input makes an instance of the case named after its index, reported
+ * on its own and created right before it runs. The input is available to the body as 'param'.
+ *
+ * Usage: PARAM_CASE(your_case_name, int, litetest::range(0, 100)) {
+ *      EXPECT(square(param)).to_be(param * param);
+ * }
+ */
+#define PARAM_CASE(name, type, inputs) \
+    static void case_##name(const type& param); \
+    static std::unique_ptr<litetest::internal::CaseParams> params_##name() { \
+        return std::make_unique<litetest::internal::GeneratedParams<type>>(inputs, case_##name); \
+    } \
+    static litetest::internal::CaseRegistration s_case_##name(#name, params_##name, __FILE__, __LINE__); \
+    static void case_##name(const type& param)
+
+/**
+ * Defines a test case run once per row of a table file, e.g. a CSV file.
+ * The file is mapped into memory and rows are located as they run, so it
+ * may be large. If it can't be read, only the case fails. Each row makes an
+ * instance of the case named after its line, reported on its own. The row
+ * is available to the body as 'row', see litetest::TableRow.
+ *
+ * Usage: TABLE_CASE(your_case_name, "data/inputs.csv") {
+ *      EXPECT(parse(row[0])).to_be(row[1]);
+ * }
+ */
+#define TABLE_CASE(name, path) \
+    static void case_##name(const litetest::TableRow& row); \
+    static std::unique_ptr<litetest::internal::CaseParams> params_##name() { \
+        return std::make_unique<litetest::internal::TableParams>(path, case_##name); \
+    } \
+    static litetest::internal::CaseRegistration s_case_##name(#name, params_##name, __FILE__, __LINE__); \
+    static void case_##name(const litetest::TableRow& row)
+
+} // litetest
+
+#endif // LITETEST_PARAMS_H
@@ -0,0 +1,251 @@
+#include "perf.h"
+#include "internal.h"
+#include "stringify.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace litetest::internal {
+
+namespace {
+
+constexpr size_t N_COUNTERS = 4;
+
+/** Per counter of PerfStats, in order, the least value read so far. */
+using CounterValues = std::array<std::optional<double>, N_COUNTERS>;
+
+/** Nanoseconds of CPU time used by the calling thread. */
+double thread_cpu_ns() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return double(ts.tv_sec) * 1e9 + double(ts.tv_nsec);
+#else
+    // Process time, the closest portable measure.
+    return double(std::clock()) * 1e9 / CLOCKS_PER_SEC;
+#endif
+}
+
+#ifdef __linux__
+
+/**
+ * Hardware counters of the calling thread, in a group so that they're
+ * enabled and read together. Counters the system doesn't provide are left
+ * out of the group.
+ */
+class CounterGroup {
+public:
+    CounterGroup() {
+        constexpr std::array<uint64_t, N_COUNTERS> configs = {
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (size_t i = 0; i < N_COUNTERS; ++i) {
+            perf_event_attr attr {};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            // Members count whenever the leader does.
+            attr.disabled = m_leader < 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, PERF_FLAG_FD_CLOEXEC));
+            if (fd < 0) {
+                continue;
+            }
+            if (m_leader < 0) {
+                m_leader = fd;
+            }
+            m_fds.push_back(fd);
+            m_counters.push_back(i);
+        }
+    }
+
+    ~CounterGroup() {
+        for (int fd: m_fds) {
+            close(fd);
+        }
+    }
+
+    CounterGroup(const CounterGroup&) = delete;
+    CounterGroup& operator=(const CounterGroup&) = delete;
+
+    /** Counts over call(fn), keeping the least values in 'values'. */
+    void measure(void (*call)(void*), void* fn, CounterValues& values) {
+        if (m_leader < 0) {
+            call(fn);
+            return;
+        }
+        ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        call(fn);
+        ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // { nr, time_enabled, time_running, value[nr] }
+        std::array<uint64_t, 3 + N_COUNTERS> data {};
+        ssize_t size = read(m_leader, data.data(), sizeof(data));
+        uint64_t n_read = data[0];
+        uint64_t enabled = data[1];
+        uint64_t running = data[2];
+        if (size < ssize_t(3 * sizeof(uint64_t)) || running == 0) {
+            // The group couldn't be scheduled on the PMU.
+            return;
+        }
+        // The group may have shared the PMU with others, and only counted
+        // part of the time.
+        double scale = double(enabled) / double(running);
+        for (size_t i = 0; i < m_counters.size() && i < n_read; ++i) {
+            double value = double(data[3 + i]) * scale;
+            std::optional<double>& least = values[m_counters[i]];
+            least = least ? std::min(*least, value) : value;
+        }
+    }
+
+private:
+    int m_leader = -1;
+    std::vector<int> m_fds;
+
+    /** Index in CounterValues of each opened counter, in group order. */
+    std::vector<size_t> m_counters;
+};
+
+#else
+
+class CounterGroup {
+public:
+    void measure(void (*call)(void*), void* fn, CounterValues&) {
+        call(fn);
+    }
+};
+
+#endif // __linux__
+
+/** Least counts and CPU time of 'n_repetitions' calls of call(fn). */
+void measure_least(CounterGroup& group, void (*call)(void*), void* fn, int n_repetitions,
+                   CounterValues& values, double& cpu_ns) {
+    cpu_ns = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < n_repetitions; ++i) {
+        double start = thread_cpu_ns();
+        group.measure(call, fn, values);
+        cpu_ns = std::min(cpu_ns, thread_cpu_ns() - start);
+    }
+}
+
+void call_nothing(void*) {}
+
+/** Accounts for a test of a missing counter in the current case's result. */
+void skip_check() {
+    if (t_context) {
+        t_context->skipped_checks++;
+    }
+}
+
+} // namespace
+
+PerfStats measure_perf(void (*call)(void*), void* fn, int n_repetitions) {
+    if (n_repetitions <= 0) {
+        throw std::invalid_argument("Performance must be measured over at least one call.");
+    }
+    CounterGroup group;
+
+    // The cost of measuring, as that of calling nothing.
+    CounterValues overhead;
+    double overhead_ns;
+    measure_least(group, call_nothing, nullptr, n_repetitions, overhead, overhead_ns);
+
+    call(fn);
+    CounterValues values;
+    double cpu_ns;
+    measure_least(group, call, fn, n_repetitions, values, cpu_ns);
+
+    auto net = [](std::optional<double> value, std::optional<double> overhead) -> std::optional<double> {
+        if (!value) {
+            return std::nullopt;
+        }
+        return std::max(0.0, *value - overhead.value_or(0));
+    };
+    PerfStats stats;
+    stats.repetitions = n_repetitions;
+    stats.instructions = net(values[0], overhead[0]);
+    stats.cycles = net(values[1], overhead[1]);
+    stats.cache_misses = net(values[2], overhead[2]);
+    stats.branch_misses = net(values[3], overhead[3]);
+    stats.cpu_ns = std::max(0.0, cpu_ns - overhead_ns);
+    return stats;
+}
+
+const ExpectPerfValue& ExpectPerfValue::to_be_less_than(double limit) const {
+    if (!m_value) {
+        skip_check();
+    }
+    else {
+        t_assertions.count++;
+        if (!(*m_value < limit)) {
+            fail("less than ", limit);
+        }
+    }
+    return *this;
+}
+
+const ExpectPerfValue& ExpectPerfValue::to_be_less_than_or_equal_to(double limit) const {
+    if (!m_value) {
+        skip_check();
+    }
+    else {
+        t_assertions.count++;
+        if (!(*m_value <= limit)) {
+            fail("less than or equal to ", limit);
+        }
+    }
+    return *this;
+}
+
+const ExpectPerfValue& ExpectPerfValue::to_be_greater_than(double limit) const {
+    if (!m_value) {
+        skip_check();
+    }
+    else {
+        t_assertions.count++;
+        if (!(*m_value > limit)) {
+            fail("greater than ", limit);
+        }
+    }
+    return *this;
+}
+
+const ExpectPerfValue& ExpectPerfValue::to_be_greater_than_or_equal_to(double limit) const {
+    if (!m_value) {
+        skip_check();
+    }
+    else {
+        t_assertions.count++;
+        if (!(*m_value >= limit)) {
+            fail("greater than or equal to ", limit);
+        }
+    }
+    return *this;
+}
+
+void ExpectPerfValue::fail(const char* expectation, double limit) const {
+    throw_failure(std::string(m_what) + " per call expected to be " + expectation + stringify(limit) +
+                  ", got " + stringify(*m_value) + " (least of " + std::to_string(m_repetitions) + " calls)",
+                  m_line);
+}
+
+} // litetest::internal
@@ -0,0 +1,125 @@
+#ifndef LITETEST_PERF_H
+#define LITETEST_PERF_H
+
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+#include "core.h"
+
+namespace litetest {
+
+/**
+ * Cost of a call as measured by measure_perf(): the least each counter read
+ * over the repeated calls, less the cost of measuring itself. Hardware
+ * counters the system doesn't provide, e.g. without a PMU or permission to
+ * use it, are missing.
+ */
+struct PerfStats {
+    /** Number of measured calls. */
+    int repetitions = 0;
+
+    /** Instructions retired, in user space. */
+    std::optional<double> instructions;
+
+    /** CPU cycles, in user space. */
+    std::optional<double> cycles;
+
+    /** Last level cache misses. */
+    std::optional<double> cache_misses;
+
+    /** Mispredicted branches. */
+    std::optional<double> branch_misses;
+
+    /** CPU time of the calling thread, in nanoseconds. Always measured. */
+    double cpu_ns = 0;
+};
+
+namespace internal {
+
+/**
+ * Measures 'n_repetitions' calls of call(fn), after a warm-up call, with
+ * hardware counters on Linux and the calling thread's CPU time everywhere.
+ */
+PerfStats measure_perf(void (*call)(void*), void* fn, int n_repetitions);
+
+/**
+ * A measured cost tested by EXPECT_PERF(). Tests of missing counters are
+ * skipped, and counted in the case's CaseReport::n_checks_skipped.
+ */
+class ExpectPerfValue {
+public:
+    ExpectPerfValue(const char* what, std::optional<double> value, int repetitions, int line)
+        : m_what(what), m_value(value), m_repetitions(repetitions), m_line(line) {}
+
+    const ExpectPerfValue& to_be_less_than(double limit) const;
+    const ExpectPerfValue& to_be_less_than_or_equal_to(double limit) const;
+    const ExpectPerfValue& to_be_greater_than(double limit) const;
+    const ExpectPerfValue& to_be_greater_than_or_equal_to(double limit) const;
+
+private:
+    [[noreturn]] LITETEST_COLD void fail(const char* expectation, double limit) const;
+
+    const char* m_what;
+    std::optional<double> m_value;
+    int m_repetitions;
+    int m_line;
+};
+
+/** Tests the costs measured by EXPECT_PERF(). */
+class ExpectPerf {
+public:
+    ExpectPerf(const PerfStats& stats, int line)
+        : m_stats(stats), m_line(line) {}
+
+    ExpectPerfValue instructions() const { return value("Instructions", m_stats.instructions); }
+
+    ExpectPerfValue cycles() const { return value("Cycles", m_stats.cycles); }
+
+    ExpectPerfValue cache_misses() const { return value("Cache misses", m_stats.cache_misses); }
+
+    ExpectPerfValue branch_misses() const { return value("Branch misses", m_stats.branch_misses); }
+
+    ExpectPerfValue cpu_ns() const { return value("CPU time (ns)", m_stats.cpu_ns); }
+
+    const PerfStats& stats() const { return m_stats; }
+
+private:
+    ExpectPerfValue value(const char* what, std::optional<double> value) const {
+        return ExpectPerfValue(what, value, m_stats.repetitions, m_line);
+    }
+
+    PerfStats m_stats;
+    int m_line;
+};
+
+} // internal
+
+/**
+ * Measures what calling 'fn' costs: instructions, cycles, cache and branch
+ * misses where hardware counters are available, and CPU time. 'fn' is
+ * called once to warm up, then 'n_repetitions' times. Only the calling
+ * thread is measured.
+ */
+template <typename F>
+PerfStats measure_perf(F&& fn, int n_repetitions = 10) {
+    auto call = [](void* f) { (*static_cast<std::remove_reference_t<F>*>(f))(); };
+    return internal::measure_perf(call, const_cast<void*>(static_cast<const void*>(std::addressof(fn))), n_repetitions);
+}
+
+/**
+ * Measures calls of 'fn' with measure_perf() and tests their cost: the least
+ * count of instructions, cycles, cache or branch misses per call, or CPU
+ * time. Tests of hardware counters the system doesn't provide are skipped;
+ * cpu_ns() is always measured. The number of calls may follow 'fn'.
+ *
+ * Usage examples:
+ *      EXPECT_PERF([&]() { parse(text); }).instructions().to_be_less_than(20000);
+ *      EXPECT_PERF([&]() { table.find(key); }, 100).cache_misses().to_be_less_than(3);
+ *      EXPECT_PERF([&]() { sort(items); }).cpu_ns().to_be_less_than(50000);
+ */
+#define EXPECT_PERF(...) (::litetest::internal::ExpectPerf(::litetest::measure_perf(__VA_ARGS__), __LINE__))
+
+} // litetest
+
+#endif // LITETEST_PERF_H
@@ -0,0 +1,109 @@
+#include "property.h"
+#include "runner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace litetest::internal {
+
+namespace {
+
+/** Finalizer of SplitMix64, mixing all bits of the input. */
+uint64_t mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+uint64_t fnv1a(std::string_view str, uint64_t hash = 0xcbf29ce484222325ull) {
+    for (char c: str) {
+        hash = (hash ^ (unsigned char) c) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+const RunTestsArgs* current_args() {
+    for (const ExecutionContext* context = t_context; context; context = context->parent) {
+        if (context->args) {
+            return context->args;
+        }
+    }
+    return nullptr;
+}
+
+/** Samples claimed at once by a thread. */
+constexpr uint64_t CHUNK_SIZE = 64;
+
+} // namespace
+
+PropertySettings property_settings() {
+    static const RunTestsArgs defaults;
+    const RunTestsArgs* args = current_args();
+    if (!args) {
+        args = &defaults;
+    }
+
+    PropertySettings settings;
+    settings.run_seed = args->seed;
+    // Each case gets its own sequence of inputs, which doesn't depend on
+    // what else is selected for the run.
+    const TestCase& test_case = current_case();
+    uint64_t location = fnv1a(test_case.name, fnv1a(current_suite().name));
+    settings.seed = mix(args->seed ^ location);
+    settings.n_samples = uint64_t(std::max(0, args->property_samples));
+    // Other jobs of the run, threads or isolated workers, keep the rest
+    // of the hardware threads busy.
+    int n_hardware_threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    settings.n_threads = args->property_threads > 0
+        ? args->property_threads
+        : std::max(1, n_hardware_threads / std::max(1, args->jobs));
+    return settings;
+}
+
+uint64_t sample_seed(uint64_t case_seed, uint64_t sample) {
+    return mix(case_seed + mix(sample));
+}
+
+std::optional<uint64_t> find_failing_sample(const PropertySettings& settings,
+                                            const std::function<bool(uint64_t)>& passes) {
+    // Threads claim chunks in increasing order and only skip those past
+    // the lowest failure found so far. Every sample below it is checked,
+    // so the failure found doesn't depend on the number of threads.
+    std::atomic<uint64_t> next_chunk = 0;
+    std::atomic<uint64_t> lowest_failure = settings.n_samples;
+    auto check_chunks = [&]() {
+        while (!cancellation_requested()) {
+            uint64_t first = next_chunk.fetch_add(CHUNK_SIZE);
+            if (first >= lowest_failure.load()) {
+                return;
+            }
+            uint64_t last = std::min(first + CHUNK_SIZE, settings.n_samples);
+            for (uint64_t sample = first; sample < last && sample < lowest_failure.load(); ++sample) {
+                if (!passes(sample)) {
+                    uint64_t lowest = lowest_failure.load();
+                    while (sample < lowest && !lowest_failure.compare_exchange_weak(lowest, sample)) {}
+                    break;
+                }
+            }
+        }
+    };
+
+    uint64_t n_chunks = (settings.n_samples + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int n_threads = int(std::min<uint64_t>(uint64_t(std::max(1, settings.n_threads)), n_chunks));
+    std::vector<std::thread> threads;
+    for (int i = 1; i < n_threads; ++i) {
+        threads.emplace_back(in_current_case(check_chunks));
+    }
+    check_chunks();
+    for (std::thread& thread: threads) {
+        thread.join();
+    }
+
+    if (lowest_failure.load() < settings.n_samples) {
+        return lowest_failure.load();
+    }
+    return std::nullopt;
+}
+
+} // litetest::internal
@@ -0,0 +1,425 @@
+#ifndef LITETEST_PROPERTY_H
+#define LITETEST_PROPERTY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "internal.h"
+
+namespace litetest {
+
+namespace internal {
+
+/** Calls fn(std::integral_constant<size_t, I>()) for each I of the sequence, in order. */
+template <typename F, size_t... Is>
+void for_each_index(F&& fn, std::index_sequence<Is...>) {
+    (fn(std::integral_constant<size_t, Is>()), ...);
+}
+
+} // internal
+
+/**
+ * Pseudo-random number generator handed to generators (SplitMix64).
+ * Cheap to seed, so that every sample of a property gets its own.
+ */
+class Random {
+public:
+    explicit Random(uint64_t seed)
+        : m_state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (m_state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    /** Uniformly distributed in [0, n). n must not be 0. */
+    uint64_t below(uint64_t n) {
+        // Reject the values that would make the modulo biased.
+        uint64_t limit = std::numeric_limits<uint64_t>::max() - std::numeric_limits<uint64_t>::max() % n;
+        uint64_t value;
+        do {
+            value = next();
+        } while (value >= limit);
+        return value % n;
+    }
+
+    /** Uniformly distributed in [0, 1). */
+    double uniform() {
+        return double(next() >> 11) * 0x1.0p-53;
+    }
+
+private:
+    uint64_t m_state;
+};
+
+/**
+ * Generates random values of a PROPERTY_CASE()'s input, and proposes
+ * simpler versions of a value that falsified the property.
+ * Generators are composed through the functions of litetest::gen.
+ */
+template <typename T>
+struct Gen {
+    using value_type = T;
+
+    std::function<T(Random&)> generate;
+
+    /** Candidates simpler than the given value, simplest first. */
+    std::function<std::vector<T>(const T&)> shrink = [](const T&) { return std::vector<T>(); };
+
+    /** Describes a value in failure messages. */
+    std::function<std::string(const T&)> describe;
+};
+
+namespace gen {
+
+/** Integers in [min, max]. Shrink towards zero, or the bound closest to it. */
+template <typename T>
+Gen<T> integers(T min = std::numeric_limits<T>::min(), T max = std::numeric_limits<T>::max()) {
+    static_assert(std::is_integral_v<T>, "integers() requires an integral type.");
+    T target = min > 0 ? min : (max < 0 ? max : T(0));
+
+    Gen<T> gen;
+    gen.generate = [=](Random& random) {
+        // Bounds and zero find many bugs, so favor them a little.
+        switch (random.below(16)) {
+            case 0: return min;
+            case 1: return max;
+            case 2: return target;
+        }
+        uint64_t span = uint64_t(max) - uint64_t(min);
+        uint64_t offset = span == std::numeric_limits<uint64_t>::max() ? random.next() : random.below(span + 1);
+        return T(uint64_t(min) + offset);
+    };
+    gen.shrink = [=](const T& value) {
+        // The target, then values halving the distance to it.
+        std::vector<T> candidates;
+        if (value == target) {
+            return candidates;
+        }
+        candidates.push_back(target);
+        // Distances are kept in the unsigned domain to avoid overflows.
+        uint64_t distance = value > target ? uint64_t(value) - uint64_t(target) : uint64_t(target) - uint64_t(value);
+        for (uint64_t step = distance / 2; step > 0; step /= 2) {
+            uint64_t remaining = distance - step;
+            candidates.push_back(value > target ? T(uint64_t(target) + remaining) : T(uint64_t(target) - remaining));
+        }
+        return candidates;
+    };
+    gen.describe = [](const T& value) {
+        return std::is_signed_v<T> ? std::to_string(int64_t(value)) : std::to_string(uint64_t(value));
+    };
+    return gen;
+}
+
+/** Floating point numbers in [min, max). Shrink towards zero, and whole numbers. */
+template <typename T = double>
+Gen<T> floats(T min, T max) {
+    static_assert(std::is_floating_point_v<T>, "floats() requires a floating point type.");
+    T target = min > 0 ? min : (max < 0 ? max : T(0));
+
+    Gen<T> gen;
+    gen.generate = [=](Random& random) {
+        return random.below(16) == 0 ? target : min + T(random.uniform()) * (max - min);
+    };
+    gen.shrink = [=](const T& value) {
+        std::vector<T> candidates;
+        for (T candidate: { target, std::trunc(value), target + (value - target) / 2 }) {
+            if (candidate != value && candidate >= min && candidate <= max &&
+                std::abs(candidate - target) < std::abs(value - target) &&
+                std::find(candidates.begin(), candidates.end(), candidate) == candidates.end()) {
+                candidates.push_back(candidate);
+            }
+        }
+        return candidates;
+    };
+    gen.describe = [](const T& value) { return stringify(value); };
+    return gen;
+}
+
+/** true or false. Shrinks to false. */
+inline Gen<bool> booleans() {
+    Gen<bool> gen;
+    gen.generate = [](Random& random) { return random.below(2) == 1; };
+    gen.shrink = [](const bool& value) { return value ? std::vector<bool> { false } : std::vector<bool>(); };
+    gen.describe = [](const bool& value) { return std::string(value ? "true" : "false"); };
+    return gen;
+}
+
+/**
+ * One of the given values, e.g. elements<std::string>({ "GET", "POST" }).
+ * Shrinks towards the first ones. Describes values with 'describe'.
+ */
+template <typename T>
+Gen<T> elements(std::vector<T> values, std::function<std::string(const T&)> describe) {
+    auto shared = std::make_shared<const std::vector<T>>(std::move(values));
+    Gen<T> gen;
+    gen.generate = [shared](Random& random) { return (*shared)[random.below(shared->size())]; };
+    gen.shrink = [shared](const T& value) {
+        auto it = std::find(shared->begin(), shared->end(), value);
+        return std::vector<T>(shared->begin(), it);
+    };
+    gen.describe = std::move(describe);
+    return gen;
+}
+
+/** Strings of ASCII characters from 'alphabet', of up to 'max_size' characters. */
+inline Gen<std::string> strings(size_t max_size = 32,
+                                std::string alphabet = "abcdefghijklmnopqrstuvwxyz"
+                                                       "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _-.,:;/\\\"'") {
+    Gen<std::string> gen;
+    gen.generate = [=](Random& random) {
+        std::string str(random.below(max_size + 1), '\0');
+        for (char& c: str) {
+            c = alphabet[random.below(alphabet.size())];
+        }
+        return str;
+    };
+    gen.shrink = [=](const std::string& str) {
+        // Shorter strings first, then simpler characters.
+        std::vector<std::string> candidates;
+        for (size_t n = str.size() / 2; n > 0; n /= 2) {
+            candidates.push_back(str.substr(0, str.size() - n));
+            candidates.push_back(str.substr(n));
+        }
+        for (size_t i = 0; i < str.size(); ++i) {
+            candidates.push_back(str.substr(0, i) + str.substr(i + 1));
+        }
+        for (size_t i = 0; i < str.size(); ++i) {
+            if (str[i] != alphabet[0]) {
+                std::string simpler = str;
+                simpler[i] = alphabet[0];
+                candidates.push_back(std::move(simpler));
+            }
+        }
+        return candidates;
+    };
+    gen.describe = [](const std::string& str) { return "\"" + str + "\""; };
+    return gen;
+}
+
+/** Vectors of 'min_size' to 'max_size' elements made by 'element'. */
+template <typename T>
+Gen<std::vector<T>> vectors(Gen<T> element, size_t min_size = 0, size_t max_size = 32) {
+    Gen<std::vector<T>> gen;
+    gen.generate = [=](Random& random) {
+        std::vector<T> values(min_size + random.below(max_size - min_size + 1));
+        for (T& value: values) {
+            value = element.generate(random);
+        }
+        return values;
+    };
+    gen.shrink = [=](const std::vector<T>& values) {
+        // Drop halves, quarters... then single elements, then shrink elements.
+        std::vector<std::vector<T>> candidates;
+        for (size_t n = values.size() / 2; n > 0 && values.size() - n >= min_size; n /= 2) {
+            candidates.emplace_back(values.begin(), values.end() - n);
+            candidates.emplace_back(values.begin() + n, values.end());
+        }
+        if (values.size() > min_size) {
+            for (size_t i = 0; i < values.size(); ++i) {
+                std::vector<T> smaller = values;
+                smaller.erase(smaller.begin() + i);
+                candidates.push_back(std::move(smaller));
+            }
+        }
+        for (size_t i = 0; i < values.size(); ++i) {
+            for (T& simpler: element.shrink(values[i])) {
+                std::vector<T> candidate = values;
+                candidate[i] = std::move(simpler);
+                candidates.push_back(std::move(candidate));
+            }
+        }
+        return candidates;
+    };
+    gen.describe = [=](const std::vector<T>& values) {
+        std::string str = "[";
+        for (size_t i = 0; i < values.size(); ++i) {
+            str += (i ? ", " : "") + element.describe(values[i]);
+        }
+        return str + "]";
+    };
+    return gen;
+}
+
+/** Tuples of values made by each generator. Components are shrunk one at a time. */
+template <typename... Ts>
+Gen<std::tuple<Ts...>> tuples(Gen<Ts>... elements) {
+    using Tuple = std::tuple<Ts...>;
+    auto gens = std::make_shared<const std::tuple<Gen<Ts>...>>(std::move(elements)...);
+
+    Gen<Tuple> gen;
+    gen.generate = [gens](Random& random) {
+        // Braced initialization guarantees left to right evaluation,
+        // so that a seed always yields the same tuple.
+        return std::apply([&](const auto&... g) { return Tuple { g.generate(random)... }; }, *gens);
+    };
+    gen.shrink = [gens](const Tuple& value) {
+        std::vector<Tuple> candidates;
+        auto shrink_component = [&](auto index) {
+            constexpr size_t I = decltype(index)::value;
+            for (auto& simpler: std::get<I>(*gens).shrink(std::get<I>(value))) {
+                Tuple candidate = value;
+                std::get<I>(candidate) = std::move(simpler);
+                candidates.push_back(std::move(candidate));
+            }
+        };
+        internal::for_each_index(shrink_component, std::index_sequence_for<Ts...>());
+        return candidates;
+    };
+    gen.describe = [gens](const Tuple& value) {
+        std::string str = "(";
+        auto describe_component = [&](auto index) {
+            constexpr size_t I = decltype(index)::value;
+            str += (I ? ", " : "") + std::get<I>(*gens).describe(std::get<I>(value));
+        };
+        internal::for_each_index(describe_component, std::index_sequence_for<Ts...>());
+        return str + ")";
+    };
+    return gen;
+}
+
+/**
+ * Values made by applying 'fn' to those of 'source'. Mapped values can't
+ * be shrunk, as there is no telling which source value they came from.
+ */
+template <typename T, typename F>
+auto map(Gen<T> source, F fn, std::function<std::string(const std::invoke_result_t<F, const T&>&)> describe) {
+    using U = std::invoke_result_t<F, const T&>;
+    Gen<U> gen;
+    gen.generate = [source, fn](Random& random) { return fn(source.generate(random)); };
+    gen.describe = std::move(describe);
+    return gen;
+}
+
+} // gen
+
+namespace internal {
+
+/** How the current case checks its property, according to the run's arguments. */
+struct PropertySettings {
+    /** Seed of the run, as passed to RunTestsArgs::seed. */
+    uint64_t run_seed;
+
+    /** Seed of the case, derived from the run's seed and the case. */
+    uint64_t seed;
+    uint64_t n_samples;
+    int n_threads;
+};
+
+PropertySettings property_settings();
+
+/** Seed of a given sample of a property. */
+uint64_t sample_seed(uint64_t case_seed, uint64_t sample);
+
+/**
+ * Calls 'passes' on samples [0, n_samples) across n_threads threads running
+ * in the current case's context, and returns the lowest sample for which it
+ * returned false, if any. Stops early once the run is cancelled.
+ */
+std::optional<uint64_t> find_failing_sample(const PropertySettings& settings,
+                                            const std::function<bool(uint64_t)>& passes);
+
+/**
+ * Checks a property over random inputs, shrinking the first falsifying
+ * input found before failing the current case.
+ */
+template <typename T>
+void check_property(const Gen<T>& gen, void (*property)(const T&)) {
+    // Returns true if the property doesn't hold for the value.
+    auto falsifies = [&](const T& value, std::string* message, int* line) {
+        try {
+            property(value);
+            return false;
+        }
+        catch (const TestFailure& failure) {
+            if (message) {
+                *message = failure.what();
+                *line = failure.line;
+            }
+        }
+        catch (const std::exception& e) {
+            if (message) {
+                *message = std::string("Unexpected exception: ") + e.what();
+            }
+        }
+        return true;
+    };
+
+    PropertySettings settings = property_settings();
+    std::optional<uint64_t> failing = find_failing_sample(settings, [&](uint64_t sample) {
+        Random random(sample_seed(settings.seed, sample));
+        return !falsifies(gen.generate(random), nullptr, nullptr);
+    });
+    if (!failing) {
+        return;
+    }
+
+    Random random(sample_seed(settings.seed, *failing));
+    T value = gen.generate(random);
+    std::string original = gen.describe(value);
+
+    // Greedily move to the first simpler candidate which still falsifies
+    // the property, until there is none. Bounded, as a safety net.
+    constexpr int MAX_SHRINKS = 10000;
+    int n_shrinks = 0;
+    bool shrunk = true;
+    while (shrunk && n_shrinks < MAX_SHRINKS) {
+        shrunk = false;
+        for (T& candidate: gen.shrink(value)) {
+            if (falsifies(candidate, nullptr, nullptr)) {
+                value = std::move(candidate);
+                n_shrinks++;
+                shrunk = true;
+                break;
+            }
+        }
+    }
+
+    std::string message;
+    int line = 0;
+    falsifies(value, &message, &line);
+    throw_failure("Property falsified by " + gen.describe(value) +
+                  (n_shrinks ? " (shrunk from " + original + " in " + std::to_string(n_shrinks) + " steps)" : "") +
+                  " at sample " + std::to_string(*failing) + " (-seed " + std::to_string(settings.run_seed) +
+                  "): " + message, line);
+}
+
+} // internal
+
+/**
+ * Defines a property-based test case: the body is run on random inputs made
+ * by 'generator' (see litetest::gen), available to it as 'param', and must
+ * hold for all of them. The first input found to fail the case is shrunk to
+ * a simpler one that still fails it, which the failure then reports along
+ * with the seed reproducing it. Inputs are checked across threads, so the
+ * body must be thread-safe. See RunTestsArgs::seed and property_samples.
+ *
+ * Usage: PROPERTY_CASE(your_case_name, litetest::gen::vectors(litetest::gen::integers<int>())) {
+ *      EXPECT(reversed(reversed(param))).to_be(param);
+ * }
+ */
+#define PROPERTY_CASE(name, generator) \
+    using property_type_##name = typename decltype(generator)::value_type; \
+    static void property_##name(const property_type_##name& param); \
+    TEST_CASE(name) { \
+        static const auto gen_##name = generator; \
+        litetest::internal::check_property(gen_##name, property_##name); \
+    } \
+    static void property_##name(const property_type_##name& param)
+
+} // litetest
+
+#endif // LITETEST_PROPERTY_H
@@ -0,0 +1,353 @@
+#include "runner.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+namespace litetest::internal {
+
+void append_json_string(std::string& out, std::string_view str) {
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    for (char c: str) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            case '\r': out += "\\r"; break;
+            default:
+                if ((unsigned char) c < 0x20) {
+                    out += "\\u00";
+                    out += HEX[(c >> 4) & 0xf];
+                    out += HEX[c & 0xf];
+                }
+                else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+const char* status_name(CaseStatus status) {
+    switch (status) {
+        case CaseStatus::PASSED:     return "passed";
+        case CaseStatus::FAILED:     return "failed";
+        case CaseStatus::INCOMPLETE: return "incomplete";
+        case CaseStatus::CRASHED:    return "crashed";
+        case CaseStatus::TIMED_OUT:  return "timed_out";
+    }
+    return "unknown";
+}
+
+namespace {
+
+void append_xml_escaped(std::string& out, std::string_view str) {
+    for (char c: str) {
+        switch (c) {
+            case '&':  out += "&amp;"; break;
+            case '<':  out += "&lt;"; break;
+            case '>':  out += "&gt;"; break;
+            case '"':  out += "&quot;"; break;
+            case '\'': out += "&apos;"; break;
+            default:
+                // Control characters other than whitespace aren't valid XML 1.0.
+                if ((unsigned char) c < 0x20 && c != '\n' && c != '\t' && c != '\r') {
+                    out += '?';
+                }
+                else {
+                    out += c;
+                }
+        }
+    }
+}
+
+/** Appends a child element of a <testcase>, unless its text is empty. */
+void append_xml_element(std::string& out, const char* name, std::string_view text) {
+    if (text.empty()) {
+        return;
+    }
+    out += "    <";
+    out += name;
+    out += '>';
+    append_xml_escaped(out, text);
+    out += "</";
+    out += name;
+    out += ">\n";
+}
+
+void append_number(std::string& out, int64_t value) {
+    out += std::to_string(value);
+}
+
+void append_property(std::string& out, const char* name, int64_t value) {
+    out += "      <property name=\"";
+    out += name;
+    out += "\" value=\"";
+    append_number(out, value);
+    out += "\"/>\n";
+}
+
+void append_double(std::string& out, double value) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.1f", value);
+    out.append(buf, size_t(n));
+}
+
+void append_seconds(std::string& out, double seconds) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.6f", seconds);
+    out.append(buf, size_t(n));
+}
+
+/**
+ * Accumulates output in a large buffer and writes it to a file in bulk.
+ * The buffer is also written out periodically, so that the file can be
+ * followed while the run is still going.
+ */
+class BufferedSink {
+public:
+    explicit BufferedSink(const std::string& path)
+        : m_file(std::fopen(path.c_str(), "wb")), m_last_flush(Clock::now()) {
+        if (!m_file) {
+            throw std::runtime_error("Failed to open report file '" + path + "' for writing.");
+        }
+        m_buffer.reserve(BUFFER_SIZE);
+    }
+
+    ~BufferedSink() {
+        flush();
+        std::fclose(m_file);
+    }
+
+    BufferedSink(const BufferedSink&) = delete;
+    BufferedSink& operator=(const BufferedSink&) = delete;
+
+    std::string& buffer() { return m_buffer; }
+
+    /** To be called after each complete event. */
+    void event_written() {
+        if (m_buffer.size() >= BUFFER_SIZE || Clock::now() - m_last_flush >= FLUSH_INTERVAL) {
+            flush();
+        }
+    }
+
+    void flush() {
+        std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+        std::fflush(m_file);
+        m_buffer.clear();
+        m_last_flush = Clock::now();
+    }
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+    static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(250);
+
+    std::FILE* m_file;
+    std::string m_buffer;
+    Clock::time_point m_last_flush;
+};
+
+/**
+ * Writes a JUnit XML report. Cases are written as they finish, under a
+ * single <testsuite> element, with their litetest suite as classname.
+ */
+class JUnitReporter : public Reporter {
+public:
+    explicit JUnitReporter(const std::string& path)
+        : m_sink(path) {
+        m_sink.buffer() += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n<testsuite name=\"litetest\">\n";
+        m_sink.flush();
+    }
+
+    void case_finished(const CaseReport& report) override {
+        std::string& out = m_sink.buffer();
+        out += "  <testcase classname=\"";
+        append_xml_escaped(out, report.suite);
+        out += "\" name=\"";
+        append_xml_escaped(out, report.name);
+        out += "\" file=\"";
+        append_xml_escaped(out, report.src_file);
+        out += "\" line=\"";
+        append_number(out, report.line);
+        out += "\" time=\"";
+        append_seconds(out, report.time.wall_seconds);
+        out += "\" assertions=\"";
+        append_number(out, report.n_assertions);
+        out += '"';
+
+        if (report.status == CaseStatus::PASSED && !report.allocations && !report.stress &&
+            !report.n_checks_skipped) {
+            out += "/>\n";
+            m_sink.event_written();
+            return;
+        }
+
+        out += ">\n";
+        if (report.allocations || report.stress || report.n_checks_skipped) {
+            out += "    <properties>\n";
+            if (report.allocations) {
+                const AllocationStats& allocations = *report.allocations;
+                append_property(out, "allocations", allocations.allocations);
+                append_property(out, "allocated_bytes", allocations.bytes);
+                append_property(out, "peak_bytes", allocations.peak_bytes);
+                append_property(out, "leaked_bytes", allocations.leaked_bytes);
+            }
+            if (report.stress) {
+                const StressStats& stress = *report.stress;
+                append_property(out, "stress_threads", stress.threads);
+                append_property(out, "stress_iterations", stress.iterations);
+                append_property(out, "stress_runs_per_second", int64_t(stress.runs_per_second));
+                append_property(out, "stress_median_iteration_ns", int64_t(stress.median_iteration_ns));
+                append_property(out, "stress_failures", stress.n_failures);
+            }
+            if (report.n_checks_skipped) {
+                append_property(out, "skipped_checks", report.n_checks_skipped);
+            }
+            out += "    </properties>\n";
+        }
+        if (report.status != CaseStatus::PASSED) {
+            const char* element = report.status == CaseStatus::FAILED ? "failure" : "error";
+            out += "    <";
+            out += element;
+            out += " type=\"";
+            out += status_name(report.status);
+            out += "\" message=\"";
+            append_xml_escaped(out, report.message);
+            out += "\"/>\n";
+            append_xml_element(out, "system-out", report.captured_stdout);
+            append_xml_element(out, "system-err", report.captured_stderr);
+        }
+        out += "  </testcase>\n";
+        m_sink.event_written();
+    }
+
+    void run_finished(const RunTestsResults&) override {
+        m_sink.buffer() += "</testsuite>\n</testsuites>\n";
+        m_sink.flush();
+    }
+
+private:
+    BufferedSink m_sink;
+};
+
+/**
+ * Writes one JSON object per line: one per finished case, followed by a
+ * summary once the run finishes.
+ */
+class JsonLinesReporter : public Reporter {
+public:
+    explicit JsonLinesReporter(const std::string& path)
+        : m_sink(path) {}
+
+    void case_finished(const CaseReport& report) override {
+        std::string& out = m_sink.buffer();
+        out += "{\"event\":\"case\",\"suite\":";
+        append_json_string(out, report.suite);
+        out += ",\"case\":";
+        append_json_string(out, report.name);
+        out += ",\"file\":";
+        append_json_string(out, report.src_file);
+        out += ",\"line\":";
+        append_number(out, report.line);
+        out += ",\"status\":\"";
+        out += status_name(report.status);
+        out += "\",\"duration\":";
+        append_seconds(out, report.time.wall_seconds);
+        out += ",\"cpu_time\":";
+        append_seconds(out, report.time.cpu_seconds);
+        out += ",\"assertions\":";
+        append_number(out, report.n_assertions);
+        if (report.n_checks_skipped) {
+            out += ",\"skipped_checks\":";
+            append_number(out, report.n_checks_skipped);
+        }
+        if (report.allocations) {
+            const AllocationStats& allocations = *report.allocations;
+            out += ",\"allocations\":{\"count\":";
+            append_number(out, allocations.allocations);
+            out += ",\"bytes\":";
+            append_number(out, allocations.bytes);
+            out += ",\"peak_bytes\":";
+            append_number(out, allocations.peak_bytes);
+            out += ",\"leaked_bytes\":";
+            append_number(out, allocations.leaked_bytes);
+            out += '}';
+        }
+        if (report.stress) {
+            const StressStats& stress = *report.stress;
+            out += ",\"stress\":{\"threads\":";
+            append_number(out, stress.threads);
+            out += ",\"iterations\":";
+            append_number(out, stress.iterations);
+            out += ",\"seconds\":";
+            append_seconds(out, stress.seconds);
+            out += ",\"runs_per_second\":";
+            append_double(out, stress.runs_per_second);
+            out += ",\"min_iteration_ns\":";
+            append_double(out, stress.min_iteration_ns);
+            out += ",\"median_iteration_ns\":";
+            append_double(out, stress.median_iteration_ns);
+            out += ",\"max_iteration_ns\":";
+            append_double(out, stress.max_iteration_ns);
+            out += ",\"failures\":";
+            append_number(out, stress.n_failures);
+            out += '}';
+        }
+        if (report.status != CaseStatus::PASSED) {
+            out += ",\"message\":";
+            append_json_string(out, report.message);
+            if (report.failure_line) {
+                out += ",\"failure_line\":";
+                append_number(out, report.failure_line);
+            }
+            if (!report.captured_stdout.empty()) {
+                out += ",\"stdout\":";
+                append_json_string(out, report.captured_stdout);
+            }
+            if (!report.captured_stderr.empty()) {
+                out += ",\"stderr\":";
+                append_json_string(out, report.captured_stderr);
+            }
+        }
+        out += "}\n";
+        m_sink.event_written();
+    }
+
+    void run_finished(const RunTestsResults& results) override {
+        std::string& out = m_sink.buffer();
+        out += "{\"event\":\"summary\",\"executed\":";
+        append_number(out, results.n_cases_executed);
+        out += ",\"passed\":";
+        append_number(out, results.n_cases_passed);
+        out += ",\"incomplete\":";
+        append_number(out, results.n_cases_incomplete);
+        out += ",\"crashed\":";
+        append_number(out, results.n_cases_crashed);
+        out += ",\"timed_out\":";
+        append_number(out, results.n_cases_timed_out);
+        out += ",\"assertions\":";
+        append_number(out, results.n_assertions);
+        out += ",\"skipped_checks\":";
+        append_number(out, results.n_checks_skipped);
+        out += "}\n";
+        m_sink.flush();
+    }
+
+private:
+    BufferedSink m_sink;
+};
+
+} // namespace
+
+std::unique_ptr<Reporter> make_reporter(const std::string& format, const std::string& path) {
+    if (format == "junit") {
+        return std::make_unique<JUnitReporter>(path.empty() ? "litetest-report.xml" : path);
+    }
+    if (format == "jsonl") {
+        return std::make_unique<JsonLinesReporter>(path.empty() ? "litetest-report.jsonl" : path);
+    }
+    throw std::invalid_argument("Unknown reporter '" + format + "'. Expected 'junit' or 'jsonl'.");
+}
+
+} // litetest::internal
@@ -0,0 +1,585 @@
+#ifndef LITETEST_RUNNER_H
+#define LITETEST_RUNNER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "litetest.h"
+
+// Declarations shared by the different test runners.
+// Not part of the public interface.
+
+namespace litetest::internal {
+
+/**
+ * Outcome of a single test case execution.
+ */
+struct CaseResult {
+    const TestSuite* suite = nullptr;
+    const TestCase* test_case = nullptr;
+    CaseStatus status = CaseStatus::PASSED;
+
+    /** Failure, exception or crash description. Empty for passed cases. */
+    std::string message;
+
+    /** Line of the failed assertion, if the case failed. */
+    int line = 0;
+
+    /** Time spent running the case. */
+    Timing time;
+
+    /** Assertions made by the case on the thread running it. */
+    int n_assertions = 0;
+
+    /** Checks the case skipped, e.g. EXPECT_PERF() tests of missing counters. */
+    int n_checks_skipped = 0;
+
+    /** Measurements, if the case is a benchmark that completed. */
+    std::optional<BenchmarkStats> benchmark;
+
+    /** Heap allocations of the case, if tracked. */
+    std::optional<AllocationStats> allocations;
+
+    /** Measurements, if the case ran in stress mode. */
+    std::optional<StressStats> stress;
+
+    /** Output captured while the case ran. Only kept if it did not pass. */
+    std::string captured_stdout;
+    std::string captured_stderr;
+};
+
+/**
+ * A suite selected for execution, along with the subset of its cases to run.
+ */
+struct SuiteRun {
+    TestSuite* suite;
+    std::vector<TestCase*> cases;
+
+    /** Selects which instances of parameterized cases run. All do if empty. */
+    std::function<bool(const TestCase&)> select_instance;
+};
+
+/**
+ * Creates the instances of a parameterized case one at a time, right before
+ * they run, so that inputs are only enumerated as far as the run gets.
+ * Instances may be taken from several threads at once.
+ */
+class InstanceCursor {
+public:
+    /** Starts at input 'first', skipping instances 'select' rejects, if given. */
+    InstanceCursor(TestCase* test_case, std::function<bool(const TestCase&)> select, size_t first = 0);
+
+    /**
+     * The next instance, or null once there are no more. Stores the index of
+     * its input into 'index', if given. Creating the case's inputs, the first
+     * time one is asked for, may throw, after which there are no more either.
+     */
+    std::unique_ptr<TestCase> next(size_t* index = nullptr);
+
+    TestCase* test_case() const { return m_test_case; }
+
+private:
+    TestCase* m_test_case;
+    std::function<bool(const TestCase&)> m_select;
+    std::mutex m_mutex;
+    size_t m_next;
+    bool m_done = false;
+};
+
+/** An instance of a parameterized case, named after the label of its input. */
+std::unique_ptr<TestCase> make_instance(const TestCase& of, const std::string& label, std::function<void()> run);
+
+using Clock = std::chrono::steady_clock;
+
+inline double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Heap allocations made by the calling thread since 'start' was read from
+ * t_allocations, with its peak_live_bytes reset to its live_bytes.
+ */
+AllocationStats allocations_since(const AllocationCounters& start);
+
+/** CPU time consumed so far by the calling thread, in seconds. */
+double thread_cpu_seconds();
+
+/**
+ * Measures wall-clock and calling thread CPU time since its construction.
+ */
+class Stopwatch {
+public:
+    Stopwatch()
+        : m_wall_start(Clock::now()), m_cpu_start(thread_cpu_seconds()) {}
+
+    Timing elapsed() const {
+        return { seconds_since(m_wall_start), thread_cpu_seconds() - m_cpu_start };
+    }
+
+private:
+    Clock::time_point m_wall_start;
+    double m_cpu_start;
+};
+
+/**
+ * Tears down the fixtures of a suite when leaving the scope of its cleanup,
+ * whether or not the cleanup throws.
+ */
+class FixtureTeardown {
+public:
+    explicit FixtureTeardown(TestSuite* suite)
+        : m_suite(suite) {}
+
+    ~FixtureTeardown() { m_suite->fixtures->clear(); }
+
+    FixtureTeardown(const FixtureTeardown&) = delete;
+    FixtureTeardown& operator=(const FixtureTeardown&) = delete;
+
+private:
+    TestSuite* m_suite;
+};
+
+/**
+ * Redirects the stdout and stderr file descriptors to temporary files while
+ * a case runs, so that output written by any means (printf, C libraries,
+ * helper threads...) is caught. The files are reused from case to case and
+ * only read back when asked to, i.e. when a case did not pass.
+ *
+ * File descriptors are shared by the whole process, so an instance must
+ * only be used while no other case runs in the same process: by the serial
+ * runner, or by an isolated worker. Does nothing where unsupported.
+ */
+class OutputCapture {
+public:
+    OutputCapture();
+    ~OutputCapture();
+
+    OutputCapture(const OutputCapture&) = delete;
+    OutputCapture& operator=(const OutputCapture&) = delete;
+
+    /** Starts capturing, discarding what was previously captured. */
+    void begin();
+
+    /** Restores the original stdout and stderr. */
+    void end();
+
+    /** True between begin() and end(). */
+    bool capturing() const { return m_capturing; }
+
+    /**
+     * Reads what was captured since the last begin(). Also works from
+     * another process sharing the files, e.g. after the capturing one crashed.
+     */
+    void read(std::string& out, std::string& err) const;
+
+private:
+    std::FILE* m_out_file = nullptr;
+    std::FILE* m_err_file = nullptr;
+    int m_out_fd = -1;
+    int m_err_fd = -1;
+    int m_saved_out_fd = -1;
+    int m_saved_err_fd = -1;
+    bool m_enabled = false;
+    bool m_capturing = false;
+};
+
+/**
+ * What a case wrote to std::cout and std::cerr while captured by a
+ * StreamCapture. Helper threads of the case write to it too.
+ */
+struct CapturedOutput {
+    std::mutex mutex;
+    std::string out;
+    std::string err;
+};
+
+/**
+ * Captures the output of cases running concurrently on threads, which
+ * share the process' file descriptors: std::cout, std::cerr and std::clog
+ * are routed, for the lifetime of the instance, to the CapturedOutput of
+ * the writing thread's context, or to where they went before for threads
+ * outside of a capturing case. Output written otherwise, e.g. by printf(),
+ * isn't captured. Only one instance may exist at a time.
+ */
+class StreamCapture {
+public:
+    StreamCapture();
+    ~StreamCapture();
+
+    StreamCapture(const StreamCapture&) = delete;
+    StreamCapture& operator=(const StreamCapture&) = delete;
+
+private:
+    /** Writes to the current context's output, if any, else to the original buffer. */
+    class RoutingBuffer : public std::streambuf {
+    public:
+        RoutingBuffer(std::streambuf* original, bool is_err)
+            : m_original(original), m_is_err(is_err) {}
+
+        std::streambuf* original() const { return m_original; }
+
+    protected:
+        int_type overflow(int_type c) override;
+        std::streamsize xsputn(const char* s, std::streamsize n) override;
+        int sync() override;
+
+    private:
+        std::streambuf* m_original;
+        bool m_is_err;
+    };
+
+    RoutingBuffer m_out;
+    RoutingBuffer m_err;
+    RoutingBuffer m_log;
+};
+
+/** Formats a duration in seconds as whole milliseconds, e.g. "1500 ms". */
+std::string format_ms(double seconds);
+
+/** Time limit of a case in seconds, 0 meaning none. */
+inline double case_time_limit(const TestCase& test_case, const RunTestsArgs& args) {
+    return test_case.timeout > 0 ? test_case.timeout : args.case_timeout;
+}
+
+class RunState;
+
+/**
+ * Thread keeping track of the deadlines of running cases and suites.
+ * A case that runs past its deadline can't be interrupted, so the watchdog
+ * reports it, along with whatever else is still running, and abandons the
+ * run through RunState::abandon().
+ */
+class Watchdog {
+public:
+    /**
+     * If given a capture, it is assumed to be active while cases run,
+     * and the output of a hung case is recovered from it.
+     */
+    Watchdog(RunState& state, OutputCapture* capture);
+    ~Watchdog();
+
+    Watchdog(const Watchdog&) = delete;
+    Watchdog& operator=(const Watchdog&) = delete;
+
+    /**
+     * Starts watching a case, or a whole suite if test_case is null, which
+     * started at 'start'. Returns an id to be passed to unwatch(), or 0 if
+     * there is no limit.
+     */
+    uint64_t watch(const TestSuite* suite, const TestCase* test_case, double limit_seconds,
+                   Clock::time_point start = Clock::now());
+
+    void unwatch(uint64_t id);
+
+private:
+    struct Entry {
+        const TestSuite* suite;
+        const TestCase* test_case;
+        Clock::time_point start;
+        Clock::time_point deadline;
+        double limit_seconds;
+    };
+
+    void loop();
+    [[noreturn]] void expire(const Entry& expired);
+
+    RunState& m_state;
+    OutputCapture* m_capture;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::map<uint64_t, Entry> m_entries;
+    uint64_t m_next_id = 1;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+/**
+ * Watches a case or suite for the lifetime of the scope.
+ * Does nothing without a watchdog.
+ */
+class WatchScope {
+public:
+    WatchScope(Watchdog* watchdog, const TestSuite* suite, const TestCase* test_case, double limit_seconds,
+               Clock::time_point start = Clock::now())
+        : m_watchdog(watchdog),
+          m_id(watchdog ? watchdog->watch(suite, test_case, limit_seconds, start) : 0) {}
+
+    ~WatchScope() {
+        if (m_watchdog) {
+            m_watchdog->unwatch(m_id);
+        }
+    }
+
+    WatchScope(const WatchScope&) = delete;
+    WatchScope& operator=(const WatchScope&) = delete;
+
+private:
+    Watchdog* m_watchdog;
+    uint64_t m_id;
+};
+
+/**
+ * Receives the results of a run as they come, to produce a report.
+ * Calls are serialized by the RunState.
+ */
+class Reporter {
+public:
+    virtual ~Reporter() = default;
+
+    virtual void case_finished(const CaseReport& report) = 0;
+
+    virtual void run_finished(const RunTestsResults& results) = 0;
+};
+
+/**
+ * Creates a reporter for the given format ('junit' or 'jsonl') writing to
+ * 'path', or to a default file name if empty.
+ */
+std::unique_ptr<Reporter> make_reporter(const std::string& format, const std::string& path);
+
+void append_json_string(std::string& out, std::string_view str);
+
+/** Lowercase name of a status, as used in reports, e.g. 'timed_out'. */
+const char* status_name(CaseStatus status);
+
+/**
+ * State shared by everything taking part in a run_tests() call.
+ * Results and console output are only touched while holding the mutex.
+ */
+class RunState {
+public:
+    explicit RunState(const RunTestsArgs& args);
+
+    const RunTestsArgs& args() const { return m_args; }
+
+    /**
+     * Accounts for a finished test case and reports it if it did not pass.
+     * Cancels the run once args().max_failures cases did not pass.
+     */
+    void record(const CaseResult& result);
+
+    const CancellationToken& cancellation() const { return m_cancellation; }
+
+    bool cancelled() const { return m_cancellation.cancelled(); }
+
+    /**
+     * Stores the first error that must abort the run (i.e. anything
+     * that is neither a TestFailure nor thrown by a test case).
+     */
+    void set_fatal_error(std::exception_ptr error);
+
+    /** Rethrows the error stored by set_fatal_error(), if any. */
+    void rethrow_fatal_error() const;
+
+    /** Completes the report of the run, if any. */
+    void finish();
+
+    /** Cases that started running, counting a parameterized case once per repetition. */
+    int n_cases_started();
+
+    /** Starts counting parameterized cases anew, see n_cases_started(). */
+    void new_repetition();
+
+    /** Accounts for time spent on a suite's setup. */
+    void record_setup(const TestSuite* suite, const Timing& time);
+
+    /** Accounts for time spent on a suite's cleanup. */
+    void record_cleanup(const TestSuite* suite, const Timing& time);
+
+    /**
+     * Gives up on a run that can't complete, e.g. because a case hung:
+     * records the given result, if any, completes the report, prints a
+     * summary and terminates the process.
+     */
+    [[noreturn]] void abandon(const std::optional<CaseResult>& result, const std::string& reason);
+
+    RunTestsResults results;
+
+    /** Total time spent on each executed suite, in seconds. */
+    std::unordered_map<const TestSuite*, double> suite_seconds;
+
+    /** Enforces time limits, if the run has any and runs in this process. */
+    Watchdog* watchdog = nullptr;
+
+    /** Captures the output of cases running on threads, if asked to. */
+    StreamCapture* stream_capture = nullptr;
+
+private:
+    SuiteReport& suite_report(const TestSuite* suite);
+
+    const RunTestsArgs& m_args;
+    std::unique_ptr<Reporter> m_reporter;
+    std::mutex m_mutex;
+    std::exception_ptr m_fatal_error;
+    std::unordered_map<const TestSuite*, size_t> m_suite_reports;
+    int m_n_failures = 0;
+    CancellationToken m_cancellation;
+
+    int m_n_cases_started = 0;
+    std::unordered_set<const TestCase*> m_started_params;
+};
+
+/**
+ * Result of a parameterized case whose inputs couldn't be created, e.g.
+ * because its table file is missing. Only that case fails.
+ */
+CaseResult inputs_failure(const TestSuite* suite, const TestCase* test_case, const std::exception& error);
+
+/**
+ * Runs a test case on the calling thread. Test failures and standard
+ * exceptions are turned into the returned result, anything else propagates.
+ * If given a capture, or a stream capture, the case's output is captured
+ * and, should the case not pass, stored into the result and the test
+ * case's cout and cerr. The cancellation token is made available to the case.
+ */
+CaseResult execute_case(TestSuite* suite,
+                        TestCase* test_case,
+                        const RunTestsArgs& args,
+                        OutputCapture* capture = nullptr,
+                        const CancellationToken* cancellation = nullptr,
+                        const StreamCapture* stream_capture = nullptr);
+
+/**
+ * Runs 'fn' in stress mode: from 'n_threads' threads running in the current
+ * case's context, released together for each iteration, until 'n_iterations'
+ * iterations completed or 'max_seconds' elapsed (0 for no limit), a thread
+ * failed or the run got cancelled. Fills 'stats', then rethrows the first
+ * failure, if any, telling which thread and iteration it came from.
+ */
+void run_stress(const std::function<void()>& fn,
+                int n_threads,
+                int64_t n_iterations,
+                double max_seconds,
+                StressStats& stats);
+
+/**
+ * Runs asynchronous cases concurrently on an event loop on the calling
+ * thread, passing each result to 'finished' as its case completes. The loop
+ * enforces time limits itself, by destroying the coroutine of a case that
+ * exceeds its limit, but only between resumptions: a case blocking past its
+ * deadline without suspending is left to the watchdog, if given. Output
+ * isn't captured, as cases interleave, and allocations aren't tracked.
+ * Cases left are skipped once the run is cancelled, except for the first,
+ * which callers check for.
+ */
+void execute_async_cases(TestSuite* suite,
+                         const std::vector<TestCase*>& cases,
+                         const RunTestsArgs& args,
+                         const CancellationToken* cancellation,
+                         const std::function<void(const CaseResult&)>& finished,
+                         Watchdog* watchdog = nullptr);
+
+/**
+ * Calls 'fn' repeatedly, scaling the number of iterations until a single
+ * sample takes at least 'sample_seconds', then measures 'n_samples' samples
+ * of that many iterations.
+ */
+BenchmarkStats measure_benchmark(const std::function<void()>& fn,
+                                 double sample_seconds,
+                                 int n_samples);
+
+/**
+ * Runs the given suites on args.jobs forked worker processes, recording
+ * their results into the state. Crashed workers are replaced and the
+ * remaining cases of their suite resumed on the replacement. Once the run is
+ * cancelled, workers are told to skip to the cleanup of their suite.
+ */
+void run_suites_isolated(RunState& state,
+                         const std::vector<SuiteRun>& runs,
+                         const RunTestsArgs& args);
+
+/**
+ * Expected durations of suites, in seconds, keyed by suite_timing_key().
+ */
+using SuiteTimings = std::unordered_map<std::string, double>;
+
+/** Identifies a suite in timing files by where it was declared. */
+std::string suite_timing_key(const TestSuite& suite);
+
+/** Loads a timing file. A missing file yields no timings. */
+SuiteTimings load_suite_timings(const std::string& path);
+
+void save_suite_timings(const std::string& path, const SuiteTimings& timings);
+
+/**
+ * Returns the suites belonging to shard 'shard_index' out of 'shard_count'.
+ * Suites are distributed so that every shard has roughly the same expected
+ * duration. If no timings are known, falls back to a deterministic split
+ * based on a hash of each suite's timing key.
+ */
+std::vector<TestSuite*> select_shard(const std::vector<TestSuite*>& suites,
+                                     int shard_index,
+                                     int shard_count,
+                                     const SuiteTimings& timings);
+
+/**
+ * Outcome of the last execution of a case.
+ */
+struct CaseHistoryEntry {
+    CaseStatus status;
+    double seconds;
+};
+
+/**
+ * Last outcome of cases, keyed by case_history_key().
+ */
+using CaseHistory = std::unordered_map<std::string, CaseHistoryEntry>;
+
+/** Identifies a case in state files by its suite, name and location. */
+std::string case_history_key(const std::string& suite,
+                             const std::string& name,
+                             const std::string& src_file,
+                             int line);
+
+/** Loads a state file. A missing file yields no history. */
+CaseHistory load_case_history(const std::string& path);
+
+/**
+ * Writes a state file. Failing to is only warned about on stderr, so that a
+ * read-only working directory doesn't fail an otherwise successful run.
+ */
+void save_case_history(const std::string& path, const CaseHistory& history);
+
+/**
+ * Per-iteration samples of benchmarks, in nanoseconds, keyed by benchmark_key().
+ */
+using Baseline = std::unordered_map<std::string, std::vector<double>>;
+
+std::string benchmark_key(const std::string& suite, const std::string& name);
+
+/** Loads a baseline file written by save_baseline(). */
+Baseline load_baseline(const std::string& path);
+
+/** Writes the samples of every benchmark in the results to a JSON file. */
+void save_baseline(const std::string& path, const RunTestsResults& results);
+
+/**
+ * Two-sided p-value of the Mann-Whitney U test, i.e. the probability of
+ * seeing samples at least this different if both came from the same
+ * distribution. Uses the normal approximation.
+ */
+double mann_whitney_p_value(const std::vector<double>& a, const std::vector<double>& b);
+
+BaselineComparison compare_to_baseline(const BenchmarkStats& stats,
+                                       const std::vector<double>& baseline_samples,
+                                       double threshold,
+                                       double alpha);
+
+} // litetest::internal
+
+#endif // LITETEST_RUNNER_H
@@ -0,0 +1,132 @@
+#include "runner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+
+namespace litetest::internal {
+
+std::string suite_timing_key(const TestSuite& suite) {
+    return suite.src_file + ":" + std::to_string(suite.line);
+}
+
+SuiteTimings load_suite_timings(const std::string& path) {
+    SuiteTimings timings;
+    std::ifstream file(path);
+
+    // Each line reads '<seconds> <key>'. Keys may contain spaces.
+    double seconds;
+    std::string key;
+    while (file >> seconds && std::getline(file >> std::ws, key)) {
+        timings[key] = seconds;
+    }
+    return timings;
+}
+
+void save_suite_timings(const std::string& path, const SuiteTimings& timings) {
+    // Sorted so that the file diffs nicely between runs.
+    std::vector<std::pair<std::string, double>> entries(timings.begin(), timings.end());
+    std::sort(entries.begin(), entries.end());
+
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open timing file '" + path + "' for writing.");
+    }
+    for (const auto& [key, seconds]: entries) {
+        file << seconds << ' ' << key << '\n';
+    }
+}
+
+/**
+ * 64-bit FNV-1a. Unlike std::hash, guaranteed to give the same
+ * results on every machine taking part in a sharded run.
+ */
+static uint64_t stable_hash(const std::string& str) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c: str) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::vector<TestSuite*> select_shard(const std::vector<TestSuite*>& suites,
+                                     int shard_index,
+                                     int shard_count,
+                                     const SuiteTimings& timings) {
+    if (shard_count < 1 || shard_index < 0 || shard_index >= shard_count) {
+        throw std::invalid_argument("Invalid shard " + std::to_string(shard_index) +
+                                    " of " + std::to_string(shard_count) + ".");
+    }
+
+    struct Entry {
+        TestSuite* suite;
+        std::string key;
+        double seconds;
+        int shard;
+    };
+
+    std::vector<Entry> entries;
+    double known_total = 0;
+    int n_known = 0;
+    for (TestSuite* suite: suites) {
+        std::string key = suite_timing_key(*suite);
+        auto it = timings.find(key);
+        double seconds = -1;
+        if (it != timings.end()) {
+            seconds = it->second;
+            known_total += seconds;
+            n_known++;
+        }
+        entries.push_back({ suite, std::move(key), seconds, 0 });
+    }
+
+    if (n_known == 0) {
+        for (Entry& entry: entries) {
+            entry.shard = int(stable_hash(entry.key) % uint64_t(shard_count));
+        }
+    }
+    else {
+        // Suites we have no data on (e.g. newly added ones) are assumed
+        // to take as long as an average suite.
+        double fallback = known_total / n_known;
+        for (Entry& entry: entries) {
+            if (entry.seconds < 0) {
+                entry.seconds = fallback;
+            }
+        }
+
+        // Longest processing time first: hand the longest remaining suite
+        // to the least loaded shard. Ties are broken by key so every
+        // machine computes the same assignment.
+        std::vector<Entry*> by_duration;
+        for (Entry& entry: entries) {
+            by_duration.push_back(&entry);
+        }
+        std::sort(by_duration.begin(), by_duration.end(), [](const Entry* a, const Entry* b) {
+            if (a->seconds != b->seconds) {
+                return a->seconds > b->seconds;
+            }
+            return a->key < b->key;
+        });
+
+        std::vector<double> loads(shard_count, 0);
+        for (Entry* entry: by_duration) {
+            auto lightest = std::min_element(loads.begin(), loads.end());
+            *lightest += entry->seconds;
+            entry->shard = int(lightest - loads.begin());
+        }
+    }
+
+    // Keep the shard's suites in their original order.
+    std::vector<TestSuite*> selected;
+    for (const Entry& entry: entries) {
+        if (entry.shard == shard_index) {
+            selected.push_back(entry.suite);
+        }
+    }
+    return selected;
+}
+
+} // litetest::internal
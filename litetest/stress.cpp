@@ -0,0 +1,122 @@
+#include "runner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace litetest::internal {
+
+void run_stress(const std::function<void()>& fn,
+                int n_threads,
+                int64_t n_iterations,
+                double max_seconds,
+                StressStats& stats) {
+    ExecutionContext* context = t_context;
+
+    // Each iteration bumps the generation to release the threads at once,
+    // then waits for all of them to be done. Threads spin rather than block,
+    // so that they start as close together as possible.
+    std::atomic<uint64_t> generation = 0;
+    std::atomic<int> n_done = 0;
+    std::atomic<bool> stop = false;
+    std::atomic<int> n_failures = 0;
+    int64_t iteration = 0;
+
+    std::mutex failure_mutex;
+    std::exception_ptr first_failure;
+    int failed_thread = 0;
+    int64_t failed_iteration = 0;
+
+    auto work = [&](int index) {
+        ContextScope scope(context);
+        int64_t initial_assertion_count = t_assertions.count;
+        uint64_t seen = 0;
+        while (true) {
+            uint64_t current;
+            while ((current = generation.load(std::memory_order_acquire)) == seen) {
+                std::this_thread::yield();
+            }
+            seen = current;
+            if (stop.load()) {
+                break;
+            }
+            try {
+                fn();
+            }
+            catch (...) {
+                n_failures++;
+                std::lock_guard lock(failure_mutex);
+                if (!first_failure) {
+                    first_failure = std::current_exception();
+                    failed_thread = index;
+                    failed_iteration = iteration;
+                }
+            }
+            n_done.fetch_add(1, std::memory_order_release);
+        }
+        if (context) {
+            context->helper_assertions += t_assertions.count - initial_assertion_count;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n_threads; ++i) {
+        threads.emplace_back(work, i);
+    }
+
+    std::vector<double> iteration_ns;
+    Clock::time_point start = Clock::now();
+    while ((n_iterations <= 0 || iteration < n_iterations) &&
+           (max_seconds <= 0 || seconds_since(start) < max_seconds) &&
+           n_failures.load() == 0 && !cancellation_requested()) {
+        n_done.store(0);
+        Clock::time_point iteration_start = Clock::now();
+        generation.fetch_add(1, std::memory_order_release);
+        while (n_done.load(std::memory_order_acquire) < n_threads) {
+            std::this_thread::yield();
+        }
+        iteration_ns.push_back(std::chrono::duration<double, std::nano>(Clock::now() - iteration_start).count());
+        iteration++;
+    }
+    stats.seconds = seconds_since(start);
+
+    stop.store(true);
+    generation.fetch_add(1, std::memory_order_release);
+    for (std::thread& thread: threads) {
+        thread.join();
+    }
+
+    stats.threads = n_threads;
+    stats.iterations = iteration;
+    stats.n_failures = n_failures.load();
+    if (stats.seconds > 0) {
+        stats.runs_per_second = double(n_threads) * double(iteration) / stats.seconds;
+    }
+    if (!iteration_ns.empty()) {
+        std::sort(iteration_ns.begin(), iteration_ns.end());
+        stats.min_iteration_ns = iteration_ns.front();
+        stats.median_iteration_ns = iteration_ns[iteration_ns.size() / 2];
+        stats.max_iteration_ns = iteration_ns.back();
+    }
+
+    if (!first_failure) {
+        return;
+    }
+    std::string where = "Thread " + std::to_string(failed_thread + 1) + " of " + std::to_string(n_threads) +
+                        ", iteration " + std::to_string(failed_iteration + 1) + ": ";
+    std::string total = stats.n_failures > 1
+        ? " (" + std::to_string(stats.n_failures) + " failures across threads)"
+        : "";
+    try {
+        std::rethrow_exception(first_failure);
+    }
+    catch (const TestFailure& failure) {
+        throw TestFailure(where + failure.what() + total, failure.test_case, failure.test_suite, failure.line);
+    }
+    catch (const std::exception& e) {
+        throw std::runtime_error(where + e.what() + total);
+    }
+}
+
+} // litetest::internal
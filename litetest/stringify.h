@@ -1,56 +1,380 @@
 #ifndef LITETEST_STRINGIFY_H
 #define LITETEST_STRINGIFY_H
 
-#include <sstream>
-#include <string>
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 namespace litetest {
 
+/**
+ * Describes 'val' for failure messages. Numbers, characters, strings,
+ * pointers, optionals, pairs, tuples and ranges are formatted directly;
+ * other types through their operator<<. May be specialized for more types.
+ * Output is bounded: ranges show their first elements and count the others,
+ * and long descriptions are cut, elisions being marked with an ellipsis.
+ */
 template <typename T>
-inline std::string stringify(const T& val) {
-    std::stringstream ss;
-    ss << val;
-    return ss.str();
-}
+std::string stringify(const T& val);
+
+namespace internal {
+
+/** Bounds of what stringify() outputs. 0 disables a bound. */
+struct StringifyLimits {
+    /** Elements shown of each range. */
+    size_t max_elements = 32;
+
+    /** Characters of a whole description. */
+    size_t max_length = 4096;
+};
+
+/** Set by run_tests() before any case runs, from RunTestsArgs. */
+inline StringifyLimits g_stringify_limits;
+
+/** Marks elided output. */
+inline constexpr std::string_view ELLIPSIS = "\xE2\x80\xA6";
+
+/**
+ * Appends to a string up to a length, past which output is dropped and the
+ * string ends with an ellipsis. Numbers are formatted with std::to_chars().
+ */
+class ValueWriter {
+public:
+    ValueWriter(std::string& out, size_t max_length)
+        : m_out(out),
+          m_end(max_length ? out.size() + max_length : std::string::npos) {}
 
-template <>
-inline std::string stringify(const unsigned char& val) {
-    std::stringstream ss;
+    /** True once the length limit was reached. Further writes are dropped. */
+    bool full() const { return m_full; }
 
-    if (val != '\0') {
-        ss << val << " (" << int(val) << ")";
+    void write(std::string_view str) {
+        if (m_full) {
+            return;
+        }
+        if (str.size() <= m_end - m_out.size()) {
+            m_out.append(str);
+            return;
+        }
+        // Don't cut UTF-8 sequences in half.
+        size_t n = m_end - m_out.size();
+        while (n > 0 && (static_cast<unsigned char>(str[n]) & 0xC0) == 0x80) {
+            n--;
+        }
+        m_out.append(str.substr(0, n));
+        m_out.append(ELLIPSIS);
+        m_full = true;
     }
-    else {
-        ss << " (" << int(val) << ")";
+
+    void write(char c) {
+        write(std::string_view(&c, 1));
     }
-    return ss.str();
-}
 
-template <>
-inline std::string stringify(const char& val) {
-    return stringify<unsigned char>(val);
+    template <typename T>
+    void write_integer(T value, int base = 10) {
+        char buffer[std::numeric_limits<T>::digits + 2];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, base);
+        write(std::string_view(buffer, result.ptr - buffer));
+    }
+
+    /** Writes the shortest representation parsing back to 'value'. */
+    template <typename T>
+    void write_floating(T value) {
+        char buffer[64];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        write(std::string_view(buffer, result.ptr - buffer));
+#else
+        // Without floating point std::to_chars(), print enough digits to round-trip.
+        int n = std::snprintf(buffer, sizeof(buffer), "%.*Lg",
+                              std::numeric_limits<T>::max_digits10, static_cast<long double>(value));
+        write(std::string_view(buffer, std::min(size_t(n), sizeof(buffer) - 1)));
+#endif
+    }
+
+    /** Writes 'n' with thousands separators. */
+    void write_count(size_t n) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), n);
+        size_t n_digits = result.ptr - digits;
+        for (size_t i = 0; i < n_digits; ++i) {
+            if (i && (n_digits - i) % 3 == 0) {
+                write(',');
+            }
+            write(digits[i]);
+        }
+    }
+
+private:
+    std::string& m_out;
+    size_t m_end;
+    bool m_full = false;
+};
+
+/** Stream buffer forwarding to a ValueWriter, failing the stream once it's full. */
+class ValueWriterBuffer : public std::streambuf {
+public:
+    ValueWriter* writer = nullptr;
+
+protected:
+    int_type overflow(int_type c) override {
+        if (writer->full()) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            writer->write(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        if (writer->full()) {
+            return 0;
+        }
+        writer->write(std::string_view(s, size_t(n)));
+        return n;
+    }
+};
+
+/** Output stream reused by a thread to run operator<< into ValueWriters. */
+struct WriterStream {
+    ValueWriterBuffer buffer;
+    std::ostream stream {&buffer};
+    bool in_use = false;
+};
+
+/** Buffer reused by a thread to build descriptions in. */
+struct StringifyBuffer {
+    std::string str;
+    bool in_use = false;
+};
+
+inline thread_local StringifyBuffer t_stringify_buffer;
+inline thread_local WriterStream t_writer_stream;
+
+template <typename T, typename = void>
+struct is_streamable : std::false_type {};
+
+template <typename T>
+struct is_streamable<T, std::void_t<decltype(std::declval<std::ostream&>() << std::declval<const T&>())>>
+    : std::true_type {};
+
+template <typename T, typename = void>
+struct is_range : std::false_type {};
+
+template <typename T>
+struct is_range<T, std::void_t<decltype(std::begin(std::declval<const T&>())),
+                               decltype(std::end(std::declval<const T&>()))>> {
+    // Some types, such as std::filesystem::path, are ranges of themselves.
+    using Element = std::remove_cv_t<std::remove_reference_t<decltype(*std::begin(std::declval<const T&>()))>>;
+    static constexpr bool value = !std::is_same_v<Element, T>;
+};
+
+template <typename T>
+struct is_optional : std::false_type {};
+
+template <typename T>
+struct is_optional<std::optional<T>> : std::true_type {};
+
+template <typename T>
+struct is_tuple : std::false_type {};
+
+template <typename... Ts>
+struct is_tuple<std::tuple<Ts...>> : std::true_type {};
+
+template <typename T1, typename T2>
+struct is_tuple<std::pair<T1, T2>> : std::true_type {};
+
+template <typename T>
+constexpr bool is_character_v = std::is_same_v<T, char> ||
+                                std::is_same_v<T, signed char> ||
+                                std::is_same_v<T, unsigned char>;
+
+inline void write_string(ValueWriter& out, std::string_view str, bool nested) {
+    // Strings stand for themselves, unless they're part of a larger value.
+    if (nested) {
+        out.write('"');
+    }
+    out.write(str);
+    if (nested) {
+        out.write('"');
+    }
 }
 
-template <>
-inline std::string stringify(const uint64_t & val) {
-    std::stringstream ss;
+template <typename T>
+void write_streamed(ValueWriter& out, const T& value) {
+    WriterStream& shared = t_writer_stream;
+    if (shared.in_use) {
+        // An operator<< describing its parts with stringify().
+        ValueWriterBuffer buffer;
+        buffer.writer = &out;
+        std::ostream stream(&buffer);
+        stream << value;
+        return;
+    }
+
+    struct Release {
+        WriterStream& shared;
 
-    ss << "0x" << std::hex << val;
-    return ss.str();
+        ~Release() {
+            // Undo whatever the operator<< changed.
+            shared.stream.clear();
+            shared.stream.flags(std::ios_base::skipws | std::ios_base::dec);
+            shared.stream.precision(6);
+            shared.stream.width(0);
+            shared.stream.fill(' ');
+            shared.in_use = false;
+        }
+    };
+    shared.in_use = true;
+    shared.buffer.writer = &out;
+    Release release { shared };
+    shared.stream << value;
 }
 
-template <>
-inline std::string stringify(const int64_t& val) {
-    std::stringstream ss;
+/** Writes 'value', which is 'nested' within a larger value if true. */
+template <typename T>
+void write_value(ValueWriter& out, const T& value, bool nested) {
+    if (out.full()) {
+        return;
+    }
 
-    if (val > 0) {
-        ss << "0x" << std::hex << val;
+    if constexpr (std::is_same_v<T, bool>) {
+        out.write(value ? "true" : "false");
+    }
+    else if constexpr (is_character_v<T>) {
+        // Both the character and its code, as either may be what matters.
+        if (value != '\0') {
+            out.write(char(value));
+        }
+        out.write(" (");
+        out.write_integer(std::is_same_v<T, char> ? int(static_cast<unsigned char>(value)) : int(value));
+        out.write(')');
+    }
+    else if constexpr (std::is_integral_v<T>) {
+        out.write_integer(value);
+    }
+    else if constexpr (std::is_floating_point_v<T>) {
+        out.write_floating(value);
+    }
+    else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+        out.write("nullptr");
+    }
+    else if constexpr (std::is_pointer_v<T> && is_character_v<std::remove_cv_t<std::remove_pointer_t<T>>>) {
+        if (value) {
+            write_string(out, reinterpret_cast<const char*>(value), nested);
+        }
+        else {
+            out.write("nullptr");
+        }
+    }
+    else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        write_string(out, std::string_view(value), nested);
+    }
+    else if constexpr (std::is_pointer_v<T>) {
+        if (value) {
+            out.write("0x");
+            out.write_integer(reinterpret_cast<uintptr_t>(value), 16);
+        }
+        else {
+            out.write("nullptr");
+        }
+    }
+    else if constexpr (is_optional<T>::value) {
+        if (value) {
+            write_value(out, *value, true);
+        }
+        else {
+            out.write("nullopt");
+        }
+    }
+    else if constexpr (is_range<T>::value) {
+        size_t max_elements = g_stringify_limits.max_elements;
+        auto it = std::begin(value);
+        auto end = std::end(value);
+        size_t n_written = 0;
+        out.write('[');
+        for (; it != end && (!max_elements || n_written < max_elements) && !out.full(); ++it, ++n_written) {
+            if (n_written) {
+                out.write(", ");
+            }
+            // Through the value type, so that proxies like those of std::vector<bool> are too.
+            const typename std::iterator_traits<decltype(it)>::value_type& element = *it;
+            write_value(out, element, true);
+        }
+        if (it != end && !out.full()) {
+            out.write(n_written ? ", " : "");
+            out.write(ELLIPSIS);
+            out.write(' ');
+            out.write_count(size_t(std::distance(it, end)));
+            out.write(" more");
+        }
+        out.write(']');
+    }
+    else if constexpr (is_tuple<T>::value) {
+        out.write('(');
+        std::apply([&](const auto&... elements) {
+            size_t i = 0;
+            ((out.write(i++ ? ", " : ""), write_value(out, elements, true)), ...);
+        }, value);
+        out.write(')');
+    }
+    else if constexpr (std::is_enum_v<T> && !is_streamable<T>::value) {
+        out.write_integer(static_cast<std::underlying_type_t<T>>(value));
+    }
+    else if constexpr (is_streamable<T>::value) {
+        if (nested) {
+            // Honors specializations of stringify() for the element type.
+            out.write(stringify(value));
+        }
+        else {
+            write_streamed(out, value);
+        }
     }
     else {
-        ss << "-0x" << std::hex << std::abs(val);
+        out.write("{object of ");
+        out.write_integer(sizeof(T));
+        out.write(" bytes}");
+    }
+}
+
+} // litetest::internal
+
+template <typename T>
+std::string stringify(const T& val) {
+    using namespace internal;
+    size_t max_length = g_stringify_limits.max_length;
+    StringifyBuffer& buffer = t_stringify_buffer;
+    if (buffer.in_use) {
+        // Called while describing another value.
+        std::string str;
+        ValueWriter out(str, max_length);
+        write_value(out, val, false);
+        return str;
     }
-    return ss.str();
+
+    struct Release {
+        StringifyBuffer& buffer;
+
+        ~Release() { buffer.in_use = false; }
+    };
+    buffer.in_use = true;
+    Release release { buffer };
+    buffer.str.clear();
+    ValueWriter out(buffer.str, max_length);
+    write_value(out, val, false);
+    return buffer.str;
 }
 
 } // litetest
@@ -0,0 +1,124 @@
+#include "runner.h"
+
+#include <algorithm>
+
+namespace litetest::internal {
+
+std::string format_ms(double seconds) {
+    return std::to_string(int64_t(seconds * 1000)) + " ms";
+}
+
+Watchdog::Watchdog(RunState& state, OutputCapture* capture)
+    : m_state(state), m_capture(capture) {
+    m_thread = std::thread([this]() { loop(); });
+}
+
+Watchdog::~Watchdog() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+uint64_t Watchdog::watch(const TestSuite* suite, const TestCase* test_case, double limit_seconds,
+                         Clock::time_point start) {
+    if (limit_seconds <= 0) {
+        return 0;
+    }
+    auto limit = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(limit_seconds));
+
+    uint64_t id;
+    {
+        std::lock_guard lock(m_mutex);
+        id = m_next_id++;
+        m_entries[id] = { suite, test_case, start, start + limit, limit_seconds };
+    }
+    m_cv.notify_all();
+    return id;
+}
+
+void Watchdog::unwatch(uint64_t id) {
+    if (id == 0) {
+        return;
+    }
+    std::lock_guard lock(m_mutex);
+    m_entries.erase(id);
+}
+
+void Watchdog::loop() {
+    std::unique_lock lock(m_mutex);
+    while (!m_stop) {
+        if (m_entries.empty()) {
+            m_cv.wait(lock);
+            continue;
+        }
+
+        auto next = std::min_element(m_entries.begin(), m_entries.end(), [](const auto& a, const auto& b) {
+            return a.second.deadline < b.second.deadline;
+        });
+        if (Clock::now() >= next->second.deadline) {
+            expire(next->second);
+        }
+        // The entry may be unwatched while waiting, so don't refer to it.
+        Clock::time_point deadline = next->second.deadline;
+        m_cv.wait_until(lock, deadline);
+    }
+}
+
+void Watchdog::expire(const Entry& expired) {
+    // Called with the mutex held, so that whatever is running stays put
+    // until the process is gone.
+    const TestCase* hung_case = expired.test_case;
+    Clock::time_point case_start = expired.start;
+    if (!hung_case) {
+        // A suite ran out of time. Blame the case of that suite in progress, if any.
+        for (const auto& [id, entry]: m_entries) {
+            if (entry.suite == expired.suite && entry.test_case) {
+                hung_case = entry.test_case;
+                case_start = entry.start;
+                break;
+            }
+        }
+    }
+
+    std::string reason;
+    if (expired.test_case) {
+        reason = "Test case '" + expired.test_case->name + "' of suite '" + expired.suite->name +
+                 "' exceeded its time limit of " + format_ms(expired.limit_seconds) + ".";
+    }
+    else {
+        reason = "Suite '" + expired.suite->name + "' exceeded its time limit of " +
+                 format_ms(expired.limit_seconds) +
+                 (hung_case ? ", while running test case '" + hung_case->name + "'." : ", outside of a test case.");
+    }
+
+    for (const auto& [id, entry]: m_entries) {
+        if (entry.test_case && entry.test_case != hung_case) {
+            reason += "\n\tStill running: test case '" + entry.test_case->name + "' of suite '" +
+                      entry.suite->name + "', for " + format_ms(seconds_since(entry.start)) + ".";
+        }
+    }
+
+    std::optional<CaseResult> result;
+    // Asynchronous cases run without capturing, so there's nothing of theirs to read.
+    bool captured = m_capture && m_capture->capturing();
+    if (m_capture) {
+        m_capture->end();
+    }
+    if (hung_case) {
+        result.emplace();
+        result->suite = expired.suite;
+        result->test_case = hung_case;
+        result->status = CaseStatus::TIMED_OUT;
+        result->time.wall_seconds = seconds_since(case_start);
+        result->message = "Timed out after " + format_ms(result->time.wall_seconds) + ".";
+        if (captured) {
+            m_capture->read(result->captured_stdout, result->captured_stderr);
+        }
+    }
+    m_state.abandon(result, reason);
+}
+
+} // litetest::internal
@@ -0,0 +1,6 @@
+#include <litetest.h>
+
+// Modules are given with -modules, and loaded by litetest_main().
+int main(int argc, char* argv[]) {
+    return litetest::litetest_main(argc, argv);
+}